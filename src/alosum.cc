@@ -43,7 +43,7 @@ ALS_type* ALS_Init(float fPhi, float gamma) {
 	result->hasha = 151261303;
 	result->hashb = 6722461; // hard coded constants for the hash table,
 							 //should really generate these randomly
-	result->n = (ALSweight_t)0;
+	result->n = 0;
 
 	result->activeHashtable =
 		(ALSCounter **)calloc(result->hashsize, sizeof(ALSCounter*));
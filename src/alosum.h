@@ -30,7 +30,7 @@ struct ALScounter_t {
 #endif
 
 typedef struct ALS_type {
-	ALSweight_t n;
+	int64_t n; // total weight of the updates
 	int hasha, hashb, hashsize;
 	int size, maxMaintenanceTime;
 	int nActive, nPassive, extra, movedFromPassive;
@@ -25,7 +25,7 @@ ALS::ALS(float fPhi, float gamma) {
 	// should really generate these randomly
     hasha = 151261303;
 	hashb = 6722461; 
-    n = (ALSweight_t) 0;
+    n = 0;
 
 	// Allocate the pointers for the active hashtable and initialize
 	activeHashtable = (ALSCounter **)calloc(hashsize, sizeof(ALSCounter*));
@@ -26,7 +26,7 @@ struct ALScounter_t {
 };
 
 class ALS {
-    ALSweight_t n;
+    int64_t n; // total weight of the updates
     int hasha, hashb, hashsize;
 	int countersize, maxMaintenanceTime;
 	int nActive, nPassive, extra, movedFromPassive;
@@ -0,0 +1,332 @@
+/********************************************************************
+Microbenchmarks for the hot kernels of the heavy hitter algorithms.
+
+Each benchmark times one kernel in isolation, on inputs prepared before
+the clock starts: the hash functions, DIM-SUM's table lookups, inserts
+and median selection, Count-Min updates and point queries over a range
+of shapes, the random and Zipf generators and the output function of every
+algorithm.  A benchmark is warmed up first and then timed over a number
+of samples; the median time per operation is reported together with the
+10th and 90th percentiles, so that a change can be judged against the
+noise of the machine.
+*********************************************************************/
+#include "countmin.h"
+#include "ccfc.h"
+#include "lossycount.h"
+#include "alosum.h"
+#include "dimsum.h"
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+
+#define BENCH_N (1<<20) // operations per sample of the streaming kernels
+#define BENCH_DOMAIN 1048575
+
+// results go through here so that the compiler keeps the work
+static volatile long sink;
+
+/**
+ * Reaches into DIM-SUM for the kernels that are not part of its interface.
+ */
+class DIMSUMBench {
+public:
+	DIMSUMBench(DIMSUM& ds) : ds(ds) {}
+
+	int ActiveSize() { return ds.activeSize; }
+	int NActive() { return ds.nActive; }
+	DIMitem_t ActiveItem(int i) { return ds.activeCounters[i].item; }
+
+	DIMCounter* FindInActive(DIMitem_t item) { return ds.find_item_in_active(item); }
+
+	/**
+	 * Empties the active table, keeping its memory.
+	 */
+	void ClearActive() {
+		memset(ds.activeHashtable, 0, ds.activeHashSize * sizeof(DIMCounter*));
+		ds.nActive = 0;
+	}
+
+	void AddToLocation(DIMitem_t item, DIMweight_t value) {
+		int hashval = static_cast<int>(hash31(ds.hasha, ds.hashb, item) % ds.activeHashSize);
+		ds.add_item_to_location(item, value, &ds.activeHashtable[hashval]);
+	}
+
+	int FindKth(int* v, int n, int k) {
+		// keep the step accounting of the maintenance away from zero, where
+		// it would release an update that is not waiting
+		ds.blocksLeftThisUpdate = -1;
+		return ds.in_place_find_kth(v, n, k, 1, 0);
+	}
+
+	DIMSUM& ds;
+};
+
+class Bench {
+public:
+	Bench(int samples, const char* filter) : samples(samples), filter(filter) {
+		printf("Benchmark\tns/op\t10th\t90th\n");
+	}
+
+	/**
+	 * Times body, which does ops operations, over the samples after a
+	 * warm-up; setup runs before each call and is not timed.
+	 */
+	void Run(std::string name, size_t ops, std::function<void()> body,
+			 std::function<void()> setup = std::function<void()>()) {
+		if (filter && name.find(filter) == std::string::npos) return;
+		std::vector<double> t;
+		int warmup = samples / 4 + 1;
+		for (int i = 0; i < warmup + samples; ++i) {
+			if (setup) setup();
+			auto start = Clock::now();
+			body();
+			double ns = (double) duration_cast<nanoseconds>(Clock::now() - start).count();
+			if (i >= warmup) t.push_back(ns / ops);
+		}
+		std::sort(t.begin(), t.end());
+		printf("%s\t%1.3f\t%1.3f\t%1.3f\n", name.c_str(), t[t.size() / 2],
+			   t[t.size() / 10], t[t.size() * 9 / 10]);
+		fflush(stdout);
+	}
+
+private:
+	int samples;
+	const char* filter;
+};
+
+void usage() {
+	std::cerr
+		<< "Usage: bench"                                  << std::endl
+		<< "\t-s        timed samples of each benchmark"   << std::endl
+		<< "\t-filter   only run benchmarks whose name contains this" << std::endl
+		<< "\t-z        skew of the Zipf streams"           << std::endl
+		<< std::endl;
+}
+
+int main(int argc, char **argv) {
+	int samples = 21;
+	const char* filter = NULL;
+	double skew = 1.0;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			samples = atoi(argv[++i]);
+			if (samples < 1) samples = 1;
+		}
+		else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		}
+		else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc) {
+			skew = atof(argv[++i]);
+		}
+		else {
+			usage();
+			return -1;
+		}
+	}
+	Bench bench(samples, filter);
+
+	// the inputs: uniform items, and a Zipf stream hashed over the domain
+	// as hh generates it
+	Tools::Random r(0xF4A54B);
+	std::vector<uint32_t> uniform(BENCH_N), zipf(BENCH_N);
+	for (size_t i = 0; i < BENCH_N; ++i) uniform[i] = (uint32_t) r.nextUniformLong() & BENCH_DOMAIN;
+	{
+		Tools::PRGZipf gen(0, BENCH_DOMAIN, skew, &r);
+		for (size_t i = 0; i < BENCH_N; ++i) zipf[i] = hash31(698124007, 5125833, gen.nextLong()) & BENCH_DOMAIN;
+	}
+
+	/*************************************************************************
+	 * Hash functions
+	 *************************************************************************/
+	bench.Run("hash31", BENCH_N, [&] {
+		long h = 0;
+		for (size_t i = 0; i < BENCH_N; ++i) h ^= hash31(151261303, 6722461, uniform[i]);
+		sink = h;
+	});
+	bench.Run("fourwise", BENCH_N, [&] {
+		long h = 0;
+		for (size_t i = 0; i < BENCH_N; ++i) h ^= fourwise(151261303, 6722461, 97, 1013, uniform[i]);
+		sink = h;
+	});
+
+	/*************************************************************************
+	 * DIM-SUM internals
+	 *************************************************************************/
+	{
+		const double phis[] = {0.001, 0.0001};
+		for (double phi : phis) {
+			DIMSUM ds(phi, 1.0);
+			DIMSUMBench in(ds);
+			char tag[32];
+			snprintf(tag, sizeof(tag), "/phi=%g", phi);
+
+			// fill the active table to just below its capacity, with the
+			// items themselves as the probes that hit
+			std::vector<uint32_t> hit, miss;
+			int fill = in.ActiveSize() - 1;
+			for (int i = 0; i < fill; ++i) in.AddToLocation(uniform[i], 1);
+			for (int i = 0; i < in.NActive(); ++i) hit.push_back(in.ActiveItem(i));
+			// items above the domain are never in the table
+			for (size_t i = 0; i < hit.size(); ++i) miss.push_back(uniform[i] + BENCH_DOMAIN + 1);
+
+			bench.Run(std::string("dimsum_find_active_hit") + tag, hit.size(), [&] {
+				long c = 0;
+				for (uint32_t item : hit) c += (long) in.FindInActive(item);
+				sink = c;
+			});
+			bench.Run(std::string("dimsum_find_active_miss") + tag, miss.size(), [&] {
+				long c = 0;
+				for (uint32_t item : miss) c += (long) in.FindInActive(item);
+				sink = c;
+			});
+			bench.Run(std::string("dimsum_add_item_to_location") + tag, fill, [&] {
+				for (int i = 0; i < fill; ++i) in.AddToLocation(uniform[i], 1);
+			}, [&] {
+				in.ClearActive();
+			});
+		}
+
+		DIMSUM ds(0.001, 1.0);
+		DIMSUMBench in(ds);
+		const int sizes[] = {1000, 10000, 100000, 1000000};
+		for (int n : sizes) {
+			std::vector<int> v(n), work(n);
+			for (int i = 0; i < n; ++i) v[i] = 1 + (int) (r.nextUniformLong() & 0xFFFF);
+			bench.Run("dimsum_find_kth/n=" + std::to_string(n), n, [&] {
+				sink = in.FindKth(&work[0], n, n / 2);
+			}, [&] {
+				work = v;
+			});
+		}
+	}
+
+	/*************************************************************************
+	 * Count-Min
+	 *************************************************************************/
+	{
+		const int widths[] = {1 << 10, 1 << 14, 1 << 18};
+		const int depths[] = {2, 4, 8};
+		for (int w : widths) {
+			for (int d : depths) {
+				CM_type* cm = CM_Init(w, d, 0);
+				std::string tag = "/w=" + std::to_string(w) + ",d=" + std::to_string(d);
+				bench.Run("cm_update" + tag, BENCH_N, [&] {
+					for (size_t i = 0; i < BENCH_N; ++i) CM_Update(cm, zipf[i], 1);
+				});
+				bench.Run("cm_pointest" + tag, BENCH_N, [&] {
+					long c = 0;
+					for (size_t i = 0; i < BENCH_N; ++i) c += CM_PointEst(cm, uniform[i]);
+					sink = c;
+				});
+				CM_Destroy(cm);
+			}
+		}
+	}
+
+	/*************************************************************************
+	 * Random generators, one at a time and in bulk
+	 *************************************************************************/
+	{
+		Tools::Random mt(0xF4A54B);
+		Tools::Random xs(0xF4A54B, Tools::RGT_XOSHIRO256);
+		std::vector<double> u(BENCH_N);
+		bench.Run("random_double/mersenne", BENCH_N, [&] {
+			double c = 0;
+			for (size_t i = 0; i < BENCH_N; ++i) c += mt.nextUniformDouble();
+			sink = (long) c;
+		});
+		bench.Run("random_double/xoshiro", BENCH_N, [&] {
+			double c = 0;
+			for (size_t i = 0; i < BENCH_N; ++i) c += xs.nextUniformDouble();
+			sink = (long) c;
+		});
+		bench.Run("random_filldouble/mersenne", BENCH_N, [&] {
+			mt.fillDouble(&u[0], BENCH_N);
+			sink = (long) u[BENCH_N - 1];
+		});
+		bench.Run("random_filldouble/xoshiro", BENCH_N, [&] {
+			xs.fillDouble(&u[0], BENCH_N);
+			sink = (long) u[BENCH_N - 1];
+		});
+	}
+
+	/*************************************************************************
+	 * Zipf generator
+	 *************************************************************************/
+	{
+		Tools::PRGZipf gen(0, BENCH_DOMAIN, skew, &r);
+		bench.Run("zipf_nextlong", BENCH_N, [&] {
+			long c = 0;
+			for (size_t i = 0; i < BENCH_N; ++i) c += gen.nextLong();
+			sink = c;
+		});
+		std::vector<int32_t> ranks(BENCH_N);
+		bench.Run("zipf_fill", BENCH_N, [&] {
+			gen.fill(&ranks[0], BENCH_N);
+			sink = ranks[BENCH_N - 1];
+		});
+		Tools::Random xs(0xF4A54B, Tools::RGT_XOSHIRO256);
+		Tools::PRGZipf xgen(0, BENCH_DOMAIN, skew, &xs);
+		bench.Run("zipf_fill/xoshiro", BENCH_N, [&] {
+			xgen.fill(&ranks[0], BENCH_N);
+			sink = ranks[BENCH_N - 1];
+		});
+	}
+
+	/*************************************************************************
+	 * Output functions, over the Zipf stream at phi = 0.001
+	 *************************************************************************/
+	{
+		const double phi = 0.001;
+		const int thresh = (int) (phi * BENCH_N) + 1;
+		const int width = (int) (2.0 / phi);
+		auto Output = [&](std::string name, std::function<std::map<uint32_t, uint32_t>()> f) {
+			bench.Run("output_" + name, 1, [&] { sink = f().size(); });
+		};
+
+		ALS_type* als = ALS_Init(phi, 1.0);
+		DIMSUM ds(phi, 1.0);
+		DIMSUMpp dspp(phi, 1.0);
+		CMH_type* cmh = CMH_Init(width, 10, 32, 8);
+		CCFC_type* ccfc = CCFC_Init(width, 10, 32, 8);
+		LC_type* lc = LC_Init(phi);
+		LCD_type* lcd = LCD_Init(phi);
+		LCL_type* lcl = LCL_Init(phi);
+		LCU_type* lcu = LCU_Init(phi);
+		for (size_t i = 0; i < BENCH_N; ++i) {
+			ALS_Update(als, zipf[i], 1);
+			ds.update(zipf[i], 1);
+			dspp.update(zipf[i], 1);
+			CMH_Update(cmh, zipf[i], 1);
+			CCFC_Update(ccfc, zipf[i], 1);
+			LC_Update(lc, zipf[i]);
+			LCD_Update(lcd, zipf[i]);
+			LCL_Update(lcl, zipf[i], 1);
+			LCU_Update(lcu, zipf[i]);
+		}
+		Output("ALS", [&] { return ALS_Output(als, thresh); });
+		Output("DS", [&] { return ds.output(thresh); });
+		Output("DSpp", [&] { return dspp.output(thresh); });
+		Output("CMH", [&] { return CMH_FindHH(cmh, thresh); });
+		Output("CCFC", [&] { return CCFC_Output(ccfc, thresh); });
+		Output("LC", [&] { return LC_Output(lc, thresh); });
+		Output("LCD", [&] { return LCD_Output(lcd, thresh); });
+		Output("LCL", [&] { return LCL_Output(lcl, thresh); });
+		Output("LCU", [&] { return LCU_Output(lcu, thresh); });
+		ALS_Destroy(als);
+		CMH_Destroy(cmh);
+		CCFC_Destroy(ccfc);
+		LC_Destroy(lc);
+		LCD_Destroy(lcd);
+		LCL_Destroy(lcl);
+		LCU_Destroy(lcu);
+	}
+	return 0;
+}
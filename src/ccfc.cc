@@ -16,6 +16,8 @@ to Creative Commons, 559 Nathan Abbott Way, Stanford, California
 #include "ccfc.h"
 #include "prng.h"
 
+#define CCFC_MAXTESTS 32 // most tests whose estimates fit on the stack
+
 CCFC_type * CCFC_Init(int buckets, int tests, int lgn, int gran)
 {
   // Create the data structure for Adaptive Group Testing
@@ -103,16 +105,22 @@ void CCFC_Update(CCFC_type * ccfc, int item, int diff)
     }
 }
 
-int CCFC_Count(CCFC_type * ccfc, int depth, int item)
+int64_t CCFC_Count(CCFC_type * ccfc, int depth, int item)
 {
 	int i;
 	int offset;
 	int * estimates;
+	int stack[CCFC_MAXTESTS+1];
 	unsigned int hash;
 	int mult;
 
 	if (depth==ccfc->logn) return(ccfc->count);
-	estimates=(int *) calloc(1+ccfc->tests, sizeof(int));
+	// called for every candidate prefix while finding heavy hitters,
+	// so keep the estimates on the stack unless there are very many tests
+	if (ccfc->tests<=CCFC_MAXTESTS)
+		estimates=stack;
+	else
+		estimates=(int *) malloc((1+ccfc->tests)*sizeof(int));
 	offset=0;
 	for (i=1;i<=ccfc->tests;i++)
 	{
@@ -127,16 +135,16 @@ int CCFC_Count(CCFC_type * ccfc, int depth, int item)
 	}
 	if (ccfc->tests==1) i=estimates[1];
 	else if (ccfc->tests==2) i=(estimates[1]+estimates[2])/2; 
-	else i=MedSelect(1+ccfc->tests/2,ccfc->tests,estimates);
-	free(estimates);
+	else i=MedNetwork(1+ccfc->tests/2,ccfc->tests,estimates);
+	if (estimates!=stack) free(estimates);
 	return(i);
 }
 
-void ccfc_recursive(CCFC_type * ccfc, int depth, int start, int thresh, std::map<uint32_t, uint32_t>& res)
+void ccfc_recursive(CCFC_type * ccfc, int depth, int start, int64_t thresh, std::map<uint32_t, uint32_t>& res)
 {
 	int i;
 	int blocksize;
-	int estcount;
+	int64_t estcount;
 	int itemshift;
 
 	estcount = CCFC_Count(ccfc,depth,start);
@@ -158,7 +166,7 @@ void ccfc_recursive(CCFC_type * ccfc, int depth, int start, int thresh, std::map
 	}
 }
 
-std::map<uint32_t, uint32_t> CCFC_Output(CCFC_type * ccfc, int thresh)
+std::map<uint32_t, uint32_t> CCFC_Output(CCFC_type * ccfc, int64_t thresh)
 {
 	std::map<uint32_t, uint32_t> res;
 	ccfc_recursive(ccfc,ccfc->logn,0,thresh,res);
@@ -0,0 +1,224 @@
+/********************************************************************
+Parallel ingestion benchmark for Count-Min sketches.
+
+Compares two ways of feeding one logical sketch from several threads:
+  shared -- every thread updates the same sketch with relaxed atomic adds
+  merge  -- every thread updates a private copy which is periodically
+            merged into the shared sketch with CM_Merge
+Each mode is run for 1, 2, 4, ... threads on the same preloaded trace and
+checked against a single threaded sketch.
+*********************************************************************/
+#include "countmin.h"
+#include "trace.h"
+
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <cstring>
+
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::time_point;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+
+void usage() {
+	std::cerr
+		<< "Usage: cmpar"                                << std::endl
+		<< "\t-f        trace file (\"\" for synthetic)"  << std::endl
+		<< "\t-np       number of synthetic packets"      << std::endl
+		<< "\t-z        synthetic skew"                   << std::endl
+		<< "\t-phi      phi, the sketch is 2/phi wide"    << std::endl
+		<< "\t-d        depth"                            << std::endl
+		<< "\t-t        maximum number of threads"        << std::endl
+		<< "\t-merge    updates between merges"           << std::endl
+		<< std::endl;
+}
+
+/**
+ * Stops the timer and returns the time elapsed in microseconds.
+ */
+uint64_t StopTheClock(time_point<Clock> &start) {
+	auto end = Clock::now();
+	microseconds diff = duration_cast<microseconds>(end - start);
+	return static_cast<uint64_t>(diff.count());
+}
+
+/**
+ * Every thread adds its slice of the trace straight into the shared sketch.
+ */
+void SharedWorker(CM_type* cm, const uint32_t* data, const uint32_t* values, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		CM_AtomicUpdate(cm, data[i], values[i]);
+	}
+}
+
+/**
+ * Every thread counts its slice into a private sketch and folds it into the
+ * shared sketch every stMerge updates, recording the time spent merging.
+ */
+void MergeWorker(CM_type* cm, std::mutex* lock, const uint32_t* data,
+				 const uint32_t* values, size_t n, size_t stMerge, uint64_t* merget) {
+	CM_type* local = CM_Copy(cm);
+	size_t cells = (size_t) local->depth * local->width;
+	*merget = 0;
+	for (size_t pos = 0; pos < n; pos += stMerge) {
+		size_t end = std::min(n, pos + stMerge);
+		for (size_t i = pos; i < end; ++i) {
+			CM_Update(local, data[i], values[i]);
+		}
+		auto start = Clock::now();
+		lock->lock();
+		CM_Merge(cm, local);
+		lock->unlock();
+		memset(local->counts[0], 0, cells * sizeof(int));
+		local->count = 0;
+		*merget += StopTheClock(start);
+	}
+	CM_Destroy(local);
+}
+
+/**
+ * Runs one mode with a given number of threads, returning the elapsed time
+ * in microseconds and whether the result matches the reference sketch.
+ */
+uint64_t RunMode(bool shared, size_t threads, CM_type* reference,
+				 const uint32_t* data, const uint32_t* values, size_t count,
+				 size_t stMerge, uint64_t* merget, bool* ok) {
+	CM_type* cm = CM_Copy(reference);
+	std::mutex lock;
+	std::vector<std::thread> pool;
+	std::vector<uint64_t> merges(threads, 0);
+	size_t slice = (count + threads - 1) / threads;
+
+	auto start = Clock::now();
+	for (size_t t = 0; t < threads; ++t) {
+		size_t from = std::min(count, t * slice);
+		size_t n = std::min(count, from + slice) - from;
+		if (shared) {
+			pool.push_back(std::thread(SharedWorker, cm, data + from, values + from, n));
+		} else {
+			pool.push_back(std::thread(MergeWorker, cm, &lock, data + from,
+									   values + from, n, stMerge, &merges[t]));
+		}
+	}
+	for (auto& th : pool) th.join();
+	uint64_t elapsed = StopTheClock(start);
+
+	*merget = 0;
+	for (auto m : merges) *merget = std::max(*merget, m);
+	*ok = (cm->count == reference->count) &&
+		(memcmp(cm->counts[0], reference->counts[0],
+				sizeof(int) * cm->depth * cm->width) == 0);
+	CM_Destroy(cm);
+	return elapsed;
+}
+
+/******************************************************************/
+
+int main(int argc, char **argv) {
+	size_t stNumberOfPackets = 10000000;
+	double dPhi = 0.001;
+	uint32_t u32Depth = 10;
+	size_t stThreads = std::thread::hardware_concurrency();
+	size_t stMerge = 65536;
+	std::string file = "../trace/nyc.dmp";
+	double dSkew = 1.0;
+
+	for (int i = 1; i < argc; ++i) {
+		if (i + 1 >= argc) {
+			usage();
+			return -1;
+		}
+		if (strcmp(argv[i], "-np") == 0) stNumberOfPackets = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-phi") == 0) dPhi = atof(argv[++i]);
+		else if (strcmp(argv[i], "-d") == 0) u32Depth = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-t") == 0) stThreads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-merge") == 0) stMerge = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-f") == 0) file = std::string(argv[++i]);
+		else if (strcmp(argv[i], "-z") == 0) dSkew = atof(argv[++i]);
+		else {
+			usage();
+			return -1;
+		}
+	}
+	if (stThreads < 1) stThreads = 1;
+	if (stMerge < 1) stMerge = 1;
+	uint32_t u32Width = 2.0 / dPhi;
+
+	// a trace file is mapped, or parsed if it is text (see trace.h)
+	Trace_type* trace = NULL;
+	std::vector<uint32_t> genData;
+	std::vector<uint32_t> genValues;
+	const uint32_t* data = NULL;
+	const uint32_t* values = NULL;
+	size_t count = 0;
+	if (file != "") {
+		std::cout << "Using file: " << file << std::endl;
+		trace = Trace_Open(file.c_str());
+		if (trace == NULL) {
+			std::cout << "Unable to load file" << std::endl;
+			exit(1);
+		}
+		std::cerr << "Finished loading file. Total number of bytes: " << trace->total << std::endl;
+		data = trace->id;
+		values = trace->len;
+		count = trace->count;
+	}
+	else {
+		prng_type* prng = prng_Init(44545, 2);
+		int64_t a = (int64_t) (prng_int(prng) % MOD);
+		int64_t b = (int64_t) (prng_int(prng) % MOD);
+		prng_Destroy(prng);
+		uint32_t u32DomainSize = 1048575;
+		Tools::Random r = Tools::Random(0xF4A54B);
+		Tools::PRGZipf zipf = Tools::PRGZipf(0, u32DomainSize, dSkew, &r);
+		for (size_t i = 0; i < stNumberOfPackets; ++i) {
+			genData.push_back(hash31(a, b, zipf.nextLong()) & u32DomainSize);
+			genValues.push_back(1);
+		}
+		data = genData.data();
+		values = genValues.data();
+		count = genData.size();
+	}
+	if (count == 0) {
+		std::cerr << "No packets to process." << std::endl;
+		return -1;
+	}
+
+	// single threaded reference for both the timing and the result check
+	CM_type* reference = CM_Init(u32Width, u32Depth, 0);
+	auto start = Clock::now();
+	for (size_t i = 0; i < count; ++i) {
+		CM_Update(reference, data[i], values[i]);
+	}
+	uint64_t base = StopTheClock(start);
+	if (base == 0) base = 1;
+
+	printf("\nMode\tThreads\tUpdates/ms\tSpeedup\tEfficiency\tMerge ms\tCheck\n");
+	printf("serial\t1\t%1.2f\t1.00\t1.00\t0.00\tok\n", 1000.0 * count / base);
+	std::vector<size_t> counts;
+	for (size_t threads = 1; threads < stThreads; threads *= 2) counts.push_back(threads);
+	counts.push_back(stThreads);
+	for (int mode = 0; mode < 2; ++mode) {
+		for (size_t threads : counts) {
+			uint64_t merget;
+			bool ok;
+			uint64_t t = RunMode(mode == 0, threads, reference, data, values, count,
+								 stMerge, &merget, &ok);
+			if (t == 0) t = 1;
+			printf("%s\t%zd\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%s\n",
+				mode == 0 ? "shared" : "merge", threads,
+				1000.0 * count / t, (double) base / t,
+				(double) base / t / threads, merget / 1000.0,
+				ok ? "ok" : "MISMATCH");
+		}
+	}
+
+	CM_Destroy(reference);
+	if (trace) Trace_Destroy(trace);
+	std::cout << std::endl;
+	return 0;
+}
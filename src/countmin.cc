@@ -15,12 +15,30 @@ to Creative Commons, 559 Nathan Abbott Way, Stanford, California
 *********************************************************************/
 
 #include <stdlib.h>
+#include <thread>
+#include <unordered_map>
 #include "prng.h"
 #include "countmin.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CM_ATOMIC_ADD(p,v)	_InterlockedExchangeAdd((volatile long *) (p),(v))
+#define CM_ATOMIC_ADD64(p,v)	_InterlockedExchangeAdd64((volatile __int64 *) (p),(v))
+#else
+#define CM_ATOMIC_ADD(p,v)	__atomic_fetch_add((p),(v),__ATOMIC_RELAXED)
+#define CM_ATOMIC_ADD64(p,v)	__atomic_fetch_add((p),(v),__ATOMIC_RELAXED)
+#endif
+
 #define min(x,y)	((x) < (y) ? (x) : (y))
 #define max(x,y)	((x) > (y) ? (x) : (y))
 
+#define CM_MAXDEPTH 32 // deepest sketch whose hash locations fit on the stack
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CM_AVX2 // build AVX2 kernels, chosen at run time if the cpu has them
+#endif
+
 double eps;	               /* 1+epsilon = approximation factor */
 double delta;                  /* probability of failure */
 
@@ -127,6 +145,52 @@ void CM_Update(CM_type * cm, unsigned int item, int diff)
 	// this can be done more efficiently if the width is a power of two
 }
 
+void CM_CUUpdate(CM_type * cm, unsigned int item, int diff)
+{
+	// conservative update: only raise the counters that are at the current
+	// minimum. The hash locations are computed once, in the same pass that
+	// finds the minimum, and reused for the write-back pass.
+	int j, ans, target;
+	int * stack[CM_MAXDEPTH], ** cell;
+
+	if (!cm) return;
+	if (diff<0)
+		{ // conservative update is only defined for insertions
+			CM_Update(cm,item,diff);
+			return;
+		}
+	if (cm->depth<=CM_MAXDEPTH)
+		cell=stack;
+	else
+		cell=(int **) malloc(cm->depth*sizeof(int *));
+	cm->count+=diff;
+	cell[0]=&cm->counts[0][hash31(cm->hasha[0],cm->hashb[0],item) % cm->width];
+	ans=*cell[0];
+	for (j=1;j<cm->depth;j++)
+		{
+			cell[j]=&cm->counts[j][hash31(cm->hasha[j],cm->hashb[j],item) % cm->width];
+			ans=min(ans,*cell[j]);
+		}
+	target=ans+diff;
+	for (j=0;j<cm->depth;j++)
+		*cell[j]=max(*cell[j],target);
+	if (cell!=stack) free(cell);
+	// this can be done more efficiently if the width is a power of two
+}
+
+void CM_AtomicUpdate(CM_type * cm, unsigned int item, int diff)
+{
+	// update a sketch shared between threads. Count-Min cells only ever 
+	// accumulate, so relaxed atomic adds are enough: no ordering is needed
+	// between cells, only that no increment is lost.
+	int j;
+
+	if (!cm) return;
+	CM_ATOMIC_ADD64(&cm->count,(int64_t) diff);
+	for (j=0;j<cm->depth;j++)
+		CM_ATOMIC_ADD(&cm->counts[j][hash31(cm->hasha[j],cm->hashb[j],item) % cm->width],diff);
+}
+
 int CM_PointEst(CM_type * cm, unsigned int query)
 {
 	// return an estimate of the count of an item by taking the minimum
@@ -146,9 +210,13 @@ int CM_PointMed(CM_type * cm, unsigned int query)
 	// useful when counts can become negative
 	// depth needs to be larger for this to work well
 	int j, * ans, result=0;
+	int stack[CM_MAXDEPTH+1];
 
 	if (!cm) return 0;
-	ans=(int *) calloc(1+cm->depth,sizeof(int));
+	if (cm->depth<=CM_MAXDEPTH)
+		ans=stack;
+	else
+		ans=(int *) malloc((1+cm->depth)*sizeof(int));
 	for (j=0;j<cm->depth;j++)
 		ans[j+1]=cm->counts[j][hash31(cm->hasha[j],cm->hashb[j],query)%cm->width];
 
@@ -163,9 +231,10 @@ int CM_PointMed(CM_type * cm, unsigned int query)
 	// special tweak for small depth sketches
 			}
 		else
-			result=(MedSelect(1+cm->depth/2,cm->depth,ans));
-	return result;
+			result=(MedNetwork(1+cm->depth/2,cm->depth,ans));
 	// need to adjust for routine starting at 1
+	if (ans!=stack) free(ans);
+	return result;
 }
 
 int CM_Compatible(CM_type * cm1, CM_type * cm2)
@@ -182,46 +251,232 @@ int CM_Compatible(CM_type * cm1, CM_type * cm2)
 	return 1;
 }
 
-int64_t CM_InnerProd(CM_type * cm1, CM_type * cm2)
+int CM_Merge(CM_type * cm1, CM_type * cm2)
+{ // add the counts of cm2 into cm1, returns 0 if they are not compatible
+	int i, n;
+	int * __restrict dst;
+	const int * __restrict src;
+
+	if (!CM_Compatible(cm1,cm2)) return 0;
+	cm1->count+=cm2->count;
+	n=cm1->depth*cm1->width;
+	dst=cm1->counts[0];
+	src=cm2->counts[0];
+	for (i=0;i<n;i++)
+		dst[i]+=src[i];
+	// both sketches are one contiguous block, so this is a single
+	// elementwise add that the compiler vectorises
+	return 1;
+}
+
+/************************************************************************/
+/* Kernels for whole-sketch estimates: inner products and F2            */
+/************************************************************************/
+
+// Each kernel sums over a stretch of one row with 64 bit accumulators. 
+// The AVX2 versions are compiled for that target only and picked once at 
+// start up, so the library still runs on machines without AVX2.
+
+static int64_t CM_dot(const int * a, const int * b, int n)
+{
+	int64_t result=0;
+	int i;
+	for (i=0;i<n;i++)
+		result+=(int64_t) a[i]*b[i];
+	return result;
+}
+
+static int64_t CM_pairsq(const int * a, int n)
+{ // sum of the squared differences of adjacent pairs of cells
+  // a cell left over at the end of an odd width row is paired with zero
+	int64_t result=0, tmp;
+	int i;
+	for (i=0;i+1<n;i+=2)
+		{
+			tmp=(int64_t) a[i]-a[i+1];
+			result+=tmp*tmp;
+		}
+	if (i<n) result+=(int64_t) a[i]*a[i];
+	return result;
+}
+
+static double CMF_dot(const double * a, const double * b, int n)
+{
+	double result=0.0;
+	int i;
+	for (i=0;i<n;i++)
+		result+=a[i]*b[i];
+	return result;
+}
+
+#ifdef CM_AVX2
+__attribute__((target("avx2")))
+static inline int64_t CM_hsum64(__m256i v)
+{
+	__m128i s=_mm_add_epi64(_mm256_castsi256_si128(v),_mm256_extracti128_si256(v,1));
+	return _mm_cvtsi128_si64(s)+_mm_extract_epi64(s,1);
+}
+
+__attribute__((target("avx2")))
+static int64_t CM_dot_avx2(const int * a, const int * b, int n)
+{
+	// _mm256_mul_epi32 multiplies the even 32 bit lanes into 64 bit 
+	// products; shifting each 64 bit lane down brings the odd lanes in
+	__m256i acc0=_mm256_setzero_si256(), acc1=_mm256_setzero_si256();
+	__m256i x,y;
+	int i;
+	for (i=0;i+8<=n;i+=8)
+		{
+			x=_mm256_loadu_si256((const __m256i *) (a+i));
+			y=_mm256_loadu_si256((const __m256i *) (b+i));
+			acc0=_mm256_add_epi64(acc0,_mm256_mul_epi32(x,y));
+			acc1=_mm256_add_epi64(acc1,_mm256_mul_epi32(_mm256_srli_epi64(x,32),
+													   _mm256_srli_epi64(y,32)));
+		}
+	return CM_hsum64(_mm256_add_epi64(acc0,acc1))+CM_dot(a+i,b+i,n-i);
+}
+
+__attribute__((target("avx2")))
+static int64_t CM_pairsq_avx2(const int * a, int n)
+{
+	// gather the even cells into the low half and the odd cells into the 
+	// high half, widen both to 64 bits and subtract; the magnitude of each
+	// difference fits in 32 unsigned bits, which _mm256_mul_epu32 squares
+	const __m256i split=_mm256_setr_epi32(0,2,4,6,1,3,5,7);
+	__m256i acc=_mm256_setzero_si256();
+	__m256i x,d,sign;
+	int i;
+	for (i=0;i+8<=n;i+=8)
+		{
+			x=_mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *) (a+i)),split);
+			d=_mm256_sub_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)),
+							   _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x,1)));
+			sign=_mm256_cmpgt_epi64(_mm256_setzero_si256(),d);
+			d=_mm256_sub_epi64(_mm256_xor_si256(d,sign),sign);
+			acc=_mm256_add_epi64(acc,_mm256_mul_epu32(d,d));
+		}
+	return CM_hsum64(acc)+CM_pairsq(a+i,n-i);
+}
+
+__attribute__((target("avx2")))
+static double CMF_dot_avx2(const double * a, const double * b, int n)
+{
+	// eight running sums instead of one: the result agrees with CMF_dot
+	// only up to rounding, as does a row summed in pieces over threads
+	__m256d acc0=_mm256_setzero_pd(), acc1=_mm256_setzero_pd();
+	double part[4];
+	int i;
+	for (i=0;i+8<=n;i+=8)
+		{
+			acc0=_mm256_add_pd(acc0,_mm256_mul_pd(_mm256_loadu_pd(a+i),_mm256_loadu_pd(b+i)));
+			acc1=_mm256_add_pd(acc1,_mm256_mul_pd(_mm256_loadu_pd(a+i+4),_mm256_loadu_pd(b+i+4)));
+		}
+	_mm256_storeu_pd(part,_mm256_add_pd(acc0,acc1));
+	return (part[0]+part[1])+(part[2]+part[3])+CMF_dot(a+i,b+i,n-i);
+}
+
+static const bool CM_useavx2=__builtin_cpu_supports("avx2");
+#endif
+
+static int64_t CM_dotrow(const int * a, const int * b, int n)
+{
+#ifdef CM_AVX2
+	if (CM_useavx2) return CM_dot_avx2(a,b,n);
+#endif
+	return CM_dot(a,b,n);
+}
+
+static int64_t CM_pairsqrow(const int * a, int n)
+{
+#ifdef CM_AVX2
+	if (CM_useavx2) return CM_pairsq_avx2(a,n);
+#endif
+	return CM_pairsq(a,n);
+}
+
+static double CMF_dotrow(const double * a, const double * b, int n)
+{
+#ifdef CM_AVX2
+	if (CM_useavx2) return CMF_dot_avx2(a,b,n);
+#endif
+	return CMF_dot(a,b,n);
+}
+
+#define CM_PARALLEL_MIN (1<<18) // fewest cells worth splitting over threads
+
+template <class R, class F>
+static void CM_rowsums(int depth, int width, int threads, R * rows, F piece)
+{
+	// rows[j] = piece(j,0,width) for every row j.  For wide sketches each
+	// row is cut into pieces, on boundaries that are multiples of 8 so 
+	// that cell pairs and vectors are never split, and the pieces are 
+	// shared out over the threads.
+
+	int pieces, ntasks, step, j, t;
+
+	if (threads<=1 || (int64_t) depth*width<CM_PARALLEL_MIN)
+		{
+			for (j=0;j<depth;j++) rows[j]=piece(j,0,width);
+			return;
+		}
+	pieces=(threads+depth-1)/depth;
+	ntasks=depth*pieces;
+	step=((width/pieces)+7) & ~7;
+	std::vector<R> part(ntasks);
+	std::vector<std::thread> pool;
+	auto run=[&](int first)
+		{
+			for (int k=first;k<ntasks;k+=threads)
+				{
+					int from=min(width,(k%pieces)*step);
+					int to=(k%pieces==pieces-1) ? width : min(width,from+step);
+					part[k]=piece(k/pieces,from,to);
+				}
+		};
+	threads=min(threads,ntasks);
+	for (t=1;t<threads;t++)
+		pool.push_back(std::thread(run,t));
+	run(0);
+	for (t=0;t<(int) pool.size();t++)
+		pool[t].join();
+	for (j=0;j<depth;j++)
+		{
+			rows[j]=0;
+			for (t=0;t<pieces;t++) rows[j]+=part[j*pieces+t];
+		}
+}
+
+int64_t CM_InnerProd(CM_type * cm1, CM_type * cm2, int threads)
 { // Estimate the inner product of two vectors by comparing their sketches
-	int i,j;
-	int64_t result, tmp;
+	int j;
+	int64_t result;
+	std::vector<int64_t> rows;
 
 	result=0;
 	if (CM_Compatible(cm1,cm2))
 		{
-			for (i=0;i<cm1->width;i++)
-	result+=cm1->counts[0][i]*cm2->counts[0][i];
+			rows.resize(cm1->depth);
+			CM_rowsums(cm1->depth,cm1->width,threads,&rows[0],
+					   [&](int j, int from, int to)
+					   { return CM_dotrow(cm1->counts[j]+from,cm2->counts[j]+from,to-from); });
+			result=rows[0];
 			for (j=1;j<cm1->depth;j++)
-	{
-		tmp=0;
-		for (i=0;i<cm1->width;i++)
-			tmp+=cm1->counts[j][i]*cm2->counts[j][i];
-		result=min(tmp,result);
-	}
+				result=min(rows[j],result);
 		}
 	return result;
 }
 
-int64_t CM_F2Est(CM_type * cm)
+int64_t CM_F2Est(CM_type * cm, int threads)
 { // Estimate the second frequency moment of the stream
-	int i,j;
-	int64_t result, tmp, *ans;
+	int64_t result;
+	std::vector<int64_t> ans;
 
 	if (!cm) return 0;
-	ans=(int64_t *) calloc(1+cm->depth,sizeof(int64_t));
-
-	for (j=0;j<cm->depth;j++)
-		{
-			result=0;
-			for (i=0;i<cm->width;i+=2)
-	{
-		tmp=(cm->counts[j][i]-cm->counts[j][i+1]);
-		result+=tmp*tmp;
-	}
-			ans[j+1]=result;
-		}
-	result=LLMedSelect((cm->depth+1)/2,cm->depth,ans);
+	ans.resize(1+cm->depth);
+	CM_rowsums(cm->depth,cm->width,threads,&ans[1],
+			   [&](int j, int from, int to)
+			   { return CM_pairsqrow(cm->counts[j]+from,to-from); });
+	result=LLMedSelect((cm->depth+1)/2,cm->depth,&ans[0]);
 	return result;
 }
 
@@ -402,31 +657,251 @@ double CMF_PointProd(CMF_type * cm1, CMF_type * cm2, unsigned int query)
 	return (ans);
 }
  
-double CMF_InnerProd(CMF_type * cm1, CMF_type * cm2)
+double CMF_InnerProd(CMF_type * cm1, CMF_type * cm2, int threads)
 { // Estimate the inner product of two vectors by comparing their sketches
-	int i,j;
-	double tmp, result;
+	int j;
+	double result;
+	std::vector<double> rows;
 
 	result=0;
 	if (CMF_Compatible(cm1,cm2))
 		{
-			for (i=0;i<cm1->width;i++)
-	result+=cm1->counts[0][i]*cm2->counts[0][i];
+			rows.resize(cm1->depth);
+			CM_rowsums(cm1->depth,cm1->width,threads,&rows[0],
+					   [&](int j, int from, int to)
+					   { return CMF_dotrow(cm1->counts[j]+from,cm2->counts[j]+from,to-from); });
+			result=rows[0];
 			for (j=1;j<cm1->depth;j++)
+				result=min(rows[j],result);
+		}
+	return result;
+}
+
+/************************************************************************/
+/* Routines to support compact Count-Min sketches                       */
+/************************************************************************/
+
+// Most cells of a wide sketch stay small, so cells are 8 or 16 bits wide.
+// A cell that would leave the range [0, cellmax) is pinned at cellmax and 
+// its true count moves to a small open addressing table of full ints.
+
+#define CMC_MINOVER 64 // initial capacity of the side table
+
+CMC_type * CMC_Init(int width, int depth, int bits, int seed)
+{     // Initialize the sketch based on user-supplied size
+	CMC_type * cm;
+	int j;
+	prng_type * prng;
+
+	if (bits!=8 && bits!=16) return(NULL);
+	cm=(CMC_type *) calloc(1,sizeof(CMC_type));
+	prng=prng_Init(-abs(seed),2); 
+	// initialize the generator to pick the hash functions
+
+	if (cm && prng)
+		{
+			cm->depth=depth;
+			cm->width=width;
+			cm->count=0;
+			cm->bits=bits;
+			cm->cellmax=(1<<bits)-1;
+			cm->cells=calloc(bits/8, cm->depth*cm->width);
+			cm->overflows=0;
+			cm->oversize=CMC_MINOVER;
+			cm->overkey=(unsigned int *)calloc(sizeof(unsigned int),cm->oversize);
+			cm->overval=(int *)calloc(sizeof(int),cm->oversize);
+			cm->hasha=(unsigned int *)calloc(sizeof(unsigned int),cm->depth);
+			cm->hashb=(unsigned int *)calloc(sizeof(unsigned int),cm->depth);
+			if (cm->cells && cm->overkey && cm->overval && cm->hasha && cm->hashb)
 	{
-		tmp=0.0;
-		for (i=0;i<cm1->width;i++)
-			tmp+=cm1->counts[j][i]*cm2->counts[j][i];
-		result=min(tmp,result);
+		for (j=0;j<depth;j++)
+			{ // same hash functions as CM_Init with the same seed
+				cm->hasha[j]=prng_int(prng) & MOD;
+				cm->hashb[j]=prng_int(prng) & MOD;
+			}
 	}
+			else cm=NULL;
 		}
-	return result;
+	prng_Destroy(prng);
+	return cm;
+}
+
+void CMC_Destroy(CMC_type * cm)
+{     // get rid of a sketch and free up the space
+	if (!cm) return;
+	free(cm->cells);
+	free(cm->overkey);
+	free(cm->overval);
+	free(cm->hasha);
+	free(cm->hashb);
+	free(cm);
+}
+
+int CMC_Size(CMC_type * cm)
+{ // return the size of the sketch in bytes, including the side table
+	int counts, over, hashes, admin;
+	if (!cm) return 0;
+	admin=sizeof(CMC_type);
+	counts=cm->width*cm->depth*(cm->bits/8);
+	over=cm->oversize*(sizeof(unsigned int)+sizeof(int));
+	hashes=cm->depth*2*sizeof(unsigned int);
+	return(admin + counts + over + hashes);
+}
+
+static int * CMC_Slot(CMC_type * cm, unsigned int cell, int insert)
+{ // find the side table entry of an escalated cell, creating it if asked
+	unsigned int key, mask, h;
+	unsigned int * oldkey;
+	int * oldval;
+	int i, oldsize;
+
+	if (insert && 2*(cm->overflows+1)>cm->oversize)
+		{ // keep the load factor at most one half
+			oldkey=cm->overkey;
+			oldval=cm->overval;
+			oldsize=cm->oversize;
+			cm->oversize*=2;
+			cm->overkey=(unsigned int *)calloc(sizeof(unsigned int),cm->oversize);
+			cm->overval=(int *)calloc(sizeof(int),cm->oversize);
+			mask=cm->oversize-1;
+			for (i=0;i<oldsize;i++)
+	if (oldkey[i])
+		{
+			h=(oldkey[i]*2654435761u) & mask;
+			while (cm->overkey[h]) h=(h+1) & mask;
+			cm->overkey[h]=oldkey[i];
+			cm->overval[h]=oldval[i];
+		}
+			free(oldkey);
+			free(oldval);
+		}
+	key=cell+1;
+	mask=cm->oversize-1;
+	h=(key*2654435761u) & mask;
+	while (cm->overkey[h]!=key)
+		{
+			if (cm->overkey[h]==0)
+	{
+		if (!insert) return(NULL);
+		cm->overkey[h]=key;
+		cm->overval[h]=0;
+		cm->overflows++;
+		break;
+	}
+			h=(h+1) & mask;
+		}
+	return(&cm->overval[h]);
+}
+
+template <typename T>
+static inline void CMC_Add(CMC_type * cm, T * cells, unsigned int cell, int diff)
+{ // add diff to one cell, escalating it if it leaves the small range
+	int v;
+	if (cells[cell]!=(T) cm->cellmax)
+		{
+			v=cells[cell]+diff;
+			if (v>=0 && v<cm->cellmax)
+	{
+		cells[cell]=(T) v;
+		return;
+	}
+			cells[cell]=(T) cm->cellmax;
+			*CMC_Slot(cm,cell,1)=v;
+		}
+	else
+		*CMC_Slot(cm,cell,0)+=diff;
+}
+
+template <typename T>
+static inline int CMC_Get(CMC_type * cm, T * cells, unsigned int cell)
+{ // read one cell, following it into the side table if it has escalated
+	if (cells[cell]!=(T) cm->cellmax) return(cells[cell]);
+	return(*CMC_Slot(cm,cell,0));
+}
+
+void CMC_Update(CMC_type * cm, unsigned int item, int diff)
+{
+	int j;
+	unsigned int offset;
+
+	if (!cm) return;
+	cm->count+=diff;
+	offset=0;
+	for (j=0;j<cm->depth;j++)
+		{
+			if (cm->bits==8)
+	CMC_Add(cm,(uint8_t *) cm->cells,
+		offset+hash31(cm->hasha[j],cm->hashb[j],item) % cm->width,diff);
+			else
+	CMC_Add(cm,(uint16_t *) cm->cells,
+		offset+hash31(cm->hasha[j],cm->hashb[j],item) % cm->width,diff);
+			offset+=cm->width;
+		}
+}
+
+int CMC_PointEst(CMC_type * cm, unsigned int query)
+{
+	// return an estimate of the count of an item by taking the minimum
+	int j, ans, est;
+	unsigned int offset;
+
+	if (!cm) return 0;
+	ans=0;
+	offset=0;
+	for (j=0;j<cm->depth;j++)
+		{
+			if (cm->bits==8)
+	est=CMC_Get(cm,(uint8_t *) cm->cells,
+		offset+hash31(cm->hasha[j],cm->hashb[j],query) % cm->width);
+			else
+	est=CMC_Get(cm,(uint16_t *) cm->cells,
+		offset+hash31(cm->hasha[j],cm->hashb[j],query) % cm->width);
+			ans=(j==0) ? est : min(ans,est);
+			offset+=cm->width;
+		}
+	return (ans);
 }
 
 /************************************************************************/
 /* Routines to support hierarchical Count-Min sketches                  */
 /************************************************************************/
 
+// The exact levels near the top of the hierarchy are split into pages of 
+// 2^CMH_PAGEBITS counters which are only allocated when first written to,
+// so a level that is touched sparsely does not cost its full size.
+// A page that has never been written reads as all zeroes.
+#define CMH_PAGEBITS 10
+#define CMH_PAGEMASK ((1<<CMH_PAGEBITS)-1)
+
+static inline int CMH_levelsize(CMH_type * cmh, int i)
+{ // number of exact counters at level i
+	return 1<<(cmh->gran*(cmh->levels-i));
+}
+
+static inline int CMH_pagesize(CMH_type * cmh, int i)
+{
+	return min(1<<CMH_PAGEBITS,CMH_levelsize(cmh,i));
+}
+
+static inline int CMH_npages(CMH_type * cmh, int i)
+{
+	return 1+((CMH_levelsize(cmh,i)-1)>>CMH_PAGEBITS);
+}
+
+static inline int CMH_exact(CMH_type * cmh, int i, unsigned int item)
+{ // read an exact counter, absent pages are zero
+	const int * page=cmh->pages[i][item>>CMH_PAGEBITS];
+	return page ? page[item & CMH_PAGEMASK] : 0;
+}
+
+static int * CMH_newpage(CMH_type * cmh, int i, unsigned int item)
+{ // the page holding item at level i, allocating it if needed
+	int ** slot=&cmh->pages[i][item>>CMH_PAGEBITS];
+	if (!*slot)
+		*slot=(int *) calloc(CMH_pagesize(cmh,i),sizeof(int));
+	return *slot;
+}
+
 CMH_type * CMH_Init(int width, int depth, int U, int gran)
 {
 	// initialize a hierarchical set of sketches for range queries 
@@ -463,6 +938,7 @@ CMH_type * CMH_Init(int width, int depth, int U, int gran)
 			cmh->freelim=cmh->levels-cmh->freelim;
 			
 			cmh->counts=(int **) calloc(sizeof(int *), 1+cmh->levels);
+			cmh->pages=(int ***) calloc(sizeof(int **), 1+cmh->levels);
 			cmh->hasha=(unsigned int **)calloc(sizeof(unsigned int *),1+cmh->levels);
 			cmh->hashb=(unsigned int **)calloc(sizeof(unsigned int *),1+cmh->levels);
 			j=1;
@@ -470,7 +946,8 @@ CMH_type * CMH_Init(int width, int depth, int U, int gran)
 	{
 		if (i>=cmh->freelim)
 			{ // allocate space for representing things exactly at high levels
-				cmh->counts[i]=(int *) calloc(1<<(cmh->gran*j),sizeof(int));
+				cmh->counts[i]=NULL;
+				cmh->pages[i]=(int **) calloc(CMH_npages(cmh,i),sizeof(int *));
 				j++;
 				cmh->hasha[i]=NULL;
 				cmh->hashb[i]=NULL;
@@ -497,13 +974,16 @@ CMH_type * CMH_Init(int width, int depth, int U, int gran)
 
 void CMH_Destroy(CMH_type * cmh)
 {  // free up the space 
-	int i;
+	int i,j;
 	if (!cmh) return;
 	for (i=0;i<cmh->levels;i++)
 		{
 			if (i>=cmh->freelim)
 	{
-		free(cmh->counts[i]);
+		if (cmh->pages[i])
+			for (j=0;j<CMH_npages(cmh,i);j++)
+				free(cmh->pages[i][j]);
+		free(cmh->pages[i]);
 	}
 			else 
 	{
@@ -513,6 +993,7 @@ void CMH_Destroy(CMH_type * cmh)
 	}
 		}
 	free(cmh->counts);
+	free(cmh->pages);
 	free(cmh->hasha);
 	free(cmh->hashb);
 	free(cmh);
@@ -530,7 +1011,9 @@ void CMH_Update(CMH_type * cmh, unsigned int item, int diff)
 			offset=0;
 			if (i>=cmh->freelim)
 	{
-		cmh->counts[i][item]+=diff;
+		int * page=cmh->pages[i][item>>CMH_PAGEBITS];
+		if (!page) page=CMH_newpage(cmh,i,item);
+		page[item & CMH_PAGEMASK]+=diff;
 		// keep exact counts at high levels in the hierarchy  
 	}
 			else
@@ -546,14 +1029,20 @@ void CMH_Update(CMH_type * cmh, unsigned int item, int diff)
 }
 
 int CMH_Size(CMH_type * cmh)
-{ // return the size used in bytes
-	int counts, hashes, admin,i;
+{ // return the size used in bytes, counting only the exact pages 
+  // which have been allocated so far
+	int counts, hashes, admin,i,j;
 	if (!cmh) return 0;
 	admin=sizeof(CMH_type);
-	counts=cmh->levels*sizeof(int **);
+	counts=2*cmh->levels*sizeof(int **);
 	for (i=0;i<cmh->levels;i++)
 		if (i>=cmh->freelim)
-			counts+=(1<<(cmh->gran*(cmh->levels-i)))*sizeof(int);
+			{
+				counts+=CMH_npages(cmh,i)*sizeof(int *);
+				for (j=0;j<CMH_npages(cmh,i);j++)
+					if (cmh->pages[i][j])
+						counts+=CMH_pagesize(cmh,i)*sizeof(int);
+			}
 		else
 			counts+=cmh->width*cmh->depth*sizeof(int);
 	hashes=(cmh->levels-cmh->freelim)*cmh->depth*2*sizeof(unsigned int);
@@ -572,7 +1061,7 @@ int CMH_count(CMH_type * cmh, int depth, int item)
 	if (depth>=cmh->levels) return(cmh->count);
 	if (depth>=cmh->freelim)
 		{ // use an exact count if there is one
-			return(cmh->counts[depth][item]);
+			return(CMH_exact(cmh,depth,item));
 		}
 	// else, use the appropriate sketch to make an estimate
 	offset=0;
@@ -590,50 +1079,120 @@ int CMH_count(CMH_type * cmh, int depth, int item)
 	return(estimate);
 }
 
-void CMH_recursive(CMH_type * cmh, int depth, int start, 
-				int thresh, std::map<uint32_t, uint32_t>& res)
-{
-	// for finding heavy hitters, recursively descend looking 
-	// for ranges that exceed the threshold
+static inline long CMH_hash(int64_t a, int64_t b, int64_t x)
+{ // hash31 from prng.cc, repeated here so the batched loops below can be
+  // inlined and vectorised by the compiler
+	int64_t result;
+	result=(a * x) + b;
+	result=((result >> HL) + result) & MOD;
+	return((long) result);
+}
 
-	int i;
-	int blocksize;
-	int estcount;
-	int itemshift;
+static void CMH_countblock(CMH_type * cmh, int depth, const unsigned int * items,
+						   int n, int * est)
+{
+	// estimate n items at one level in a single pass: one row of the
+	// sketch at a time, so the hash parameters and the row stay in 
+	// registers and cache while all the items are looked up
 
-	estcount=CMH_count(cmh,depth,start);
+	int i,j;
+	int64_t a,b,h,q;
+	const int * row;
+	int c;
+	double inv;
 
-	if (estcount>=thresh) 
-	{
-		if (depth==0)
+	if (depth>=cmh->levels)
 		{
-			if (res.size()<cmh->width)
-			{
-				res.insert(std::pair<uint32_t, uint32_t>(start, estcount));
-				//results[0]++;
-				//results[results[0]]=start;
-			}
+			for (i=0;i<n;i++) est[i]=cmh->count;
+			return;
 		}
-		else
-		{
-			blocksize=1<<cmh->gran;
-			itemshift=start<<cmh->gran;
-			// assumes that gran is an exact multiple of the bit dept
-			for (i=0;i<blocksize;i++)
-				CMH_recursive(cmh,depth-1,itemshift+i,thresh,res);
+	if (depth>=cmh->freelim)
+		{ // use exact counts if there are some
+			for (i=0;i<n;i++) est[i]=CMH_exact(cmh,depth,items[i]);
+			return;
 		}
+	inv=1.0/cmh->width;
+	for (j=0;j<cmh->depth;j++)
+		{
+			a=cmh->hasha[depth][j];
+			b=cmh->hashb[depth][j];
+			row=cmh->counts[depth]+j*cmh->width;
+			for (i=0;i<n;i++)
+	{ // h % width through the reciprocal, which avoids a division per item
+		h=CMH_hash(a,b,items[i]);
+		q=(int64_t) (h*inv);
+		h-=q*cmh->width;
+		if (h>=cmh->width) h-=cmh->width;
+		if (h<0) h+=cmh->width;
+		c=row[h];
+		est[i]=(j==0) ? c : min(est[i],c);
 	}
+		}
 }
 
-std::map<uint32_t, uint32_t> CMH_FindHH(CMH_type * cmh, int thresh)
+std::map<uint32_t, uint32_t> CMH_FindHH(CMH_type * cmh, int64_t thresh)
 {
 	// find all items whose estimated count is greater than phi n
+	// descend the hierarchy breadth first: all children of the ranges
+	// that passed at one level are estimated together in one batch
+
 	std::map<uint32_t, uint32_t> res;
-	CMH_recursive(cmh,cmh->levels,0,thresh,res);
+	std::vector<unsigned int> frontier, children;
+	std::vector<int> est;
+	unsigned int blocksize;
+	size_t f,i,n;
+	int depth;
+
+	if (!cmh || cmh->count<thresh) return(res);
+	blocksize=1<<cmh->gran;
+	frontier.push_back(0);
+	for (depth=cmh->levels-1;depth>=0 && !frontier.empty();depth--)
+		{
+			n=frontier.size()*blocksize;
+			children.resize(n);
+			est.resize(n);
+			for (f=0;f<frontier.size();f++)
+	for (i=0;i<blocksize;i++)
+		children[f*blocksize+i]=(frontier[f]<<cmh->gran)+i;
+			// assumes that gran is an exact multiple of the bit depth
+
+			CMH_countblock(cmh,depth,&children[0],(int) n,&est[0]);
+
+			frontier.clear();
+			for (i=0;i<n;i++)
+	if (est[i]>=thresh)
+		{
+			if (depth==0)
+				res.insert(std::pair<uint32_t, uint32_t>(children[i], est[i]));
+			else
+				frontier.push_back(children[i]);
+		}
+		}
 	return(res);
 }
 
-int CMH_Rangesum(CMH_type * cmh, int start, int end)
+// Cache shared by the queries of one batch.  Sketched levels cost depth
+// hashes per node, so their estimates are kept per level; the binary
+// searches behind quantiles all probe the same midpoints near the top of
+// the search, so the prefix and suffix sums are kept as well.
+typedef struct CMH_memo{
+	std::vector<std::unordered_map<int,int> > nodes;
+	std::unordered_map<unsigned long,int> prefix, suffix;
+} CMH_memo;
+
+static int CMH_memocount(CMH_type * cmh, int depth, int item, CMH_memo * memo)
+{
+	// as CMH_count, but look sketched levels up in the memo first
+
+	if (!memo || depth>=cmh->freelim) return CMH_count(cmh,depth,item);
+	std::unordered_map<int,int>::iterator it=memo->nodes[depth].find(item);
+	if (it!=memo->nodes[depth].end()) return it->second;
+	int est=CMH_count(cmh,depth,item);
+	memo->nodes[depth][item]=est;
+	return est;
+}
+
+static int CMH_rangesum(CMH_type * cmh, int start, int end, CMH_memo * memo)
 {
 	// compute a range sum: 
 	// start at bottom level
@@ -655,7 +1214,7 @@ int CMH_Rangesum(CMH_type * cmh, int start, int end)
 			if ((end-start+1)<(1<<cmh->gran))
 	{ // at the highest level, avoid overcounting	
 		for (i=start;i<end;i++)
-			result+=CMH_count(cmh,depth,i);
+			result+=CMH_memocount(cmh,depth,i,memo);
 		break;
 	}
 			else
@@ -665,12 +1224,12 @@ int CMH_Rangesum(CMH_type * cmh, int start, int end)
 		if ((leftend>0) && (start<end))
 			for (i=0;i<leftend;i++)
 				{
-		result+=CMH_count(cmh,depth,start+i);
+		result+=CMH_memocount(cmh,depth,start+i,memo);
 				}
 		if ((rightend>0) && (start<end))
 			for (i=0;i<rightend;i++)
 				{
-		result+=CMH_count(cmh,depth,end-i-1);
+		result+=CMH_memocount(cmh,depth,end-i-1,memo);
 				}
 		start=start>>cmh->gran;
 		if (leftend>0) start++;
@@ -680,7 +1239,27 @@ int CMH_Rangesum(CMH_type * cmh, int start, int end)
 	return result;
 }
 
-int CMH_FindRange(CMH_type * cmh, int sum)
+int CMH_Rangesum(CMH_type * cmh, int start, int end)
+{
+	return CMH_rangesum(cmh,start,end,NULL);
+}
+
+static int CMH_cachedsum(CMH_type * cmh, unsigned long start, unsigned long end,
+			 std::unordered_map<unsigned long,int> * cache, unsigned long key,
+			 CMH_memo * memo)
+{
+	// a range sum whose result is remembered under key, if there is a memo
+	int est;
+
+	if (!memo) return CMH_rangesum(cmh,start,end,NULL);
+	std::unordered_map<unsigned long,int>::iterator it=cache->find(key);
+	if (it!=cache->end()) return it->second;
+	est=CMH_rangesum(cmh,start,end,memo);
+	(*cache)[key]=est;
+	return est;
+}
+
+static int CMH_findrange(CMH_type * cmh, int sum, CMH_memo * memo)
 {
 	unsigned long low, high, mid=0, est;
 	int i;
@@ -692,7 +1271,7 @@ int CMH_FindRange(CMH_type * cmh, int sum)
 	for (i=0;i<cmh->U;i++)
 		{
 			mid=(low+high)/2;
-			est=CMH_Rangesum(cmh,0,mid);
+			est=CMH_cachedsum(cmh,0,mid,memo ? &memo->prefix : NULL,mid,memo);
 			if (est>sum)
 	high=mid;
 			else
@@ -702,7 +1281,12 @@ int CMH_FindRange(CMH_type * cmh, int sum)
 
 }
 
-int CMH_AltFindRange(CMH_type * cmh, int sum)
+int CMH_FindRange(CMH_type * cmh, int sum)
+{
+	return CMH_findrange(cmh,sum,NULL);
+}
+
+static int CMH_altfindrange(CMH_type * cmh, int sum, CMH_memo * memo)
 {
 	unsigned long low, high, mid=0, est, top;
 	int i;
@@ -715,7 +1299,7 @@ int CMH_AltFindRange(CMH_type * cmh, int sum)
 	for (i=0;i<cmh->U;i++)
 		{
 			mid=(low+high)/2;
-			est=CMH_Rangesum(cmh,mid,top);
+			est=CMH_cachedsum(cmh,mid,top,memo ? &memo->suffix : NULL,mid,memo);
 			if (est<sum)
 	high=mid;
 			else
@@ -725,38 +1309,83 @@ int CMH_AltFindRange(CMH_type * cmh, int sum)
 
 }
 
-int CMH_Quantile(CMH_type * cmh, float frac)
+int CMH_AltFindRange(CMH_type * cmh, int sum)
+{
+	return CMH_altfindrange(cmh,sum,NULL);
+}
+
+static int CMH_quantile(CMH_type * cmh, float frac, CMH_memo * memo)
 {
 	// find a quantile by doing the appropriate range search
 	if (frac<0) return 0;
 	if (frac>1) 
 		return 1<<cmh->U;
-	return ((CMH_FindRange(cmh,cmh->count*frac)+
-		 CMH_AltFindRange(cmh,cmh->count*(1-frac)))/2);
+	return ((CMH_findrange(cmh,cmh->count*frac,memo)+
+		 CMH_altfindrange(cmh,cmh->count*(1-frac),memo))/2);
 	// each result gives a lower/upper bound on the location of the quantile
 	// with high probability, these will be close: only a small number of values
 	// will be between the estimates. 
 }
 
-int64_t CMH_F2Est(CMH_type * cmh)
+int CMH_Quantile(CMH_type * cmh, float frac)
+{
+	return CMH_quantile(cmh,frac,NULL);
+}
+
+void CMH_Quantiles(CMH_type * cmh, int n, const float * fracs, int * results)
+{
+	// answer n quantile queries together; each result equals what 
+	// CMH_Quantile would give, but the searches share every range sum
+	// and every sketched estimate they have in common
+
+	CMH_memo memo;
+	int i;
+
+	memo.nodes.resize(cmh->levels);
+	for (i=0;i<n;i++)
+		results[i]=CMH_quantile(cmh,fracs[i],&memo);
+}
+
+void CMH_Rangesums(CMH_type * cmh, int n, const int * starts, const int * ends,
+		   int * results)
+{
+	// answer n range sums together, sharing the sketched estimates of
+	// dyadic nodes that several ranges cover
+
+	CMH_memo memo;
+	int i;
+
+	memo.nodes.resize(cmh->levels);
+	for (i=0;i<n;i++)
+		results[i]=CMH_rangesum(cmh,starts[i],ends[i],&memo);
+}
+
+int64_t CMH_F2Est(CMH_type * cmh, int threads)
 {
 	// A heuristic for estimating the F2 of a stream
 	// tends to overestimate a great deal on non-skewed streams
 
-	int i,j,k;
-	int64_t est, result;
+	int i,j;
+	int64_t result;
 
-	k=0; result=-1;
-	for (i=0;i<cmh->depth;i++)
-		{
-			est=0;
-			for (j=0;j<cmh->width;j++)
-	{
-		est+=(int64_t) cmh->counts[0][k] * (int64_t) cmh->counts[0][k];
-		k++;
-	}
-			if (result<0) result=est; else
-	result=min(result,est);
+	if (cmh->freelim==0)
+		{ // the bottom level is exact, so the F2 is too
+			result=0;
+			for (i=0;i<CMH_npages(cmh,0);i++)
+				if (cmh->pages[0][i])
+					for (j=0;j<CMH_pagesize(cmh,0);j++)
+						result+=(int64_t) cmh->pages[0][i][j] * cmh->pages[0][i][j];
+			return result;
 		}
+	std::vector<int64_t> rows(cmh->depth);
+	CM_rowsums(cmh->depth,cmh->width,threads,&rows[0],
+			   [&](int i, int from, int to)
+			   {
+				   const int * row=cmh->counts[0]+i*cmh->width+from;
+				   return CM_dotrow(row,row,to-from);
+			   });
+	result=rows[0];
+	for (i=1;i<cmh->depth;i++)
+		result=min(result,rows[i]);
 	return result;
 }
@@ -32,20 +32,44 @@ extern void CM_Destroy(CM_type *);
 extern int CM_Size(CM_type *);
 
 extern void CM_Update(CM_type *, unsigned int, int); 
+extern void CM_CUUpdate(CM_type *, unsigned int, int);
+extern void CM_AtomicUpdate(CM_type *, unsigned int, int);
+extern int CM_Compatible(CM_type *, CM_type *);
+extern int CM_Merge(CM_type *, CM_type *);
 extern int CM_PointEst(CM_type *, unsigned int);
 extern int CM_PointMed(CM_type *, unsigned int);
-extern int64_t CM_InnerProd(CM_type *, CM_type *);
+extern int64_t CM_InnerProd(CM_type *, CM_type *, int threads=1);
 extern int CM_Residue(CM_type *, unsigned int *);
-extern int64_t CM_F2Est(CM_type *);
+extern int64_t CM_F2Est(CM_type *, int threads=1);
 
 extern CMF_type * CMF_Init(int, int, int);
 extern CMF_type * CMF_Copy(CMF_type *);
 extern void CMF_Destroy(CMF_type *);
 extern int CMF_Size(CMF_type *);
 extern void CMF_Update(CMF_type *, unsigned int, double); 
-extern double CMF_InnerProd(CMF_type *, CMF_type *);
+extern double CMF_InnerProd(CMF_type *, CMF_type *, int threads=1);
 extern double CMF_PointProd(CMF_type *, CMF_type *, unsigned int);
 
+typedef struct CMC_type{ // compact sketch: small cells that escalate 
+	int64_t count;
+	int depth;
+	int width;
+	int bits; // 8 or 16 bits per cell
+	int cellmax; // a cell holding this value has escalated to the side table
+	void * cells;
+	int overflows; // number of escalated cells
+	int oversize; // capacity of the side table, a power of two
+	unsigned int * overkey; // cell index + 1 of each side entry, 0 if empty
+	int * overval; // full width count of each escalated cell
+	unsigned int *hasha, *hashb;
+} CMC_type;
+
+extern CMC_type * CMC_Init(int, int, int, int);
+extern void CMC_Destroy(CMC_type *);
+extern int CMC_Size(CMC_type *);
+extern void CMC_Update(CMC_type *, unsigned int, int);
+extern int CMC_PointEst(CMC_type *, unsigned int);
+
 typedef struct CMH_type{
 	int64_t count;
 	int U; // size of the universe in bits
@@ -54,7 +78,8 @@ typedef struct CMH_type{
 	int freelim; // up to which level to keep exact counts
 	int depth;
 	int width;
-	int ** counts;
+	int ** counts; // sketches for the levels below freelim
+	int *** pages; // page tables for the exact levels, filled on demand
 	unsigned int **hasha, **hashb;
 } CMH_type;
 
@@ -64,11 +89,13 @@ extern void CMH_Destroy(CMH_type *);
 extern int CMH_Size(CMH_type *);
 
 extern void CMH_Update(CMH_type *, unsigned int, int);
-extern std::map<uint32_t, uint32_t> CMH_FindHH(CMH_type *, int);
+extern std::map<uint32_t, uint32_t> CMH_FindHH(CMH_type *, int64_t);
 extern int CMH_Rangesum(CMH_type *, int, int);
 
 extern int CMH_FindRange(CMH_type * cmh, int);
 extern int CMH_Quantile(CMH_type *cmh,float);
-extern int64_t CMH_F2Est(CMH_type *);
+extern void CMH_Quantiles(CMH_type *, int, const float *, int *);
+extern void CMH_Rangesums(CMH_type *, int, const int *, const int *, int *);
+extern int64_t CMH_F2Est(CMH_type *, int threads=1);
 
 #endif
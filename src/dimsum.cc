@@ -5,16 +5,19 @@
 DIMSUM::DIMSUM(float ep, float g) {
     epsilon = ep;
     gamma = g;
+    // init_active and init_passive count steps against these
+    blocksLeft = 0;
+    blocksLeftThisUpdate = 0;
     
     // Initialize the active and passive
     nActive = 0; 
     nPassive = 0;
 
     //TODO: Need to figure out why has to be odd.
-    passiveSize = (int) (ceil(gamma / epsilon) + ceil(1 / epsilon) - 1);
-    activeSize = (int) (ceil(gamma / epsilon) + ceil(1 / epsilon) - 1);
-    activeHashSize = DIM_HASHMULT * activeSize;
-    passiveHashSize = DIM_HASHMULT * passiveSize;
+    passiveSize = table_size(epsilon, gamma);
+    activeSize = table_size(epsilon, gamma);
+    activeHashSize = hash_size(epsilon, gamma);
+    passiveHashSize = hash_size(epsilon, gamma);
     // TODO: Understand this random constant lmao
     maxMaintenanceTime = BLOCK_MULTIPLIER * activeSize + activeHashSize + 1;
 
@@ -27,7 +30,7 @@ DIMSUM::DIMSUM(float ep, float g) {
 	// randomly later. Currently hardcoded for paper reproduciblity.
     hasha = 151261303;
 	hashb = 6722461; 
-    n = (DIMweight_t) 0;
+    n = 0;
 
     init_active();
     init_passive();
@@ -44,17 +47,32 @@ DIMSUM::DIMSUM(float ep, float g) {
     clearedFromPassive = passiveHashSize;
     copied2buffer = 0;
 
+    swaps = 0;
+    stalls = 0;
+
     // Make the maintenance thread and shit
     all_done = false;
-    std::thread maintenance_thread(&DIMSUM::maintenance, this);
-    maintenance_thread.detach();
+    maintenance_thread = std::thread(&DIMSUM::maintenance, this);
+}
+
+
+int DIMSUM::table_size(float ep, float g) {
+    return (int) (ceil(g / ep) + ceil(1 / ep) - 1);
 }
 
+int DIMSUM::hash_size(float ep, float g) {
+    return DIM_HASHMULT * table_size(ep, g);
+}
 
 DIMSUM::~DIMSUM() {
     #if DIMSUM_VERBOSE
         std::cout << "Destroying" << std::endl;
     #endif
+    // Wake the maintenance thread so it sees all_done, and wait for it to
+    // leave before freeing the tables it works on.
+    all_done = true;
+    maintenance_step_mutex.unlock();
+    maintenance_thread.join();
     destroy_passive();
     destroy_active();
     maintenance_step_mutex.unlock();
@@ -93,6 +111,8 @@ void DIMSUM::update(DIMitem_t item, DIMweight_t value) {
         // the number of steps left should be zero. Or else we're in trouble.
 		// assert(stepsLeft == 0);
 		// check that clearing the passive table is done
+		swaps++;
+		if (finish_maintenance()) stalls++;
 		assert(movedFromPassive == nPassive);
 		if (clearedFromPassive != passiveHashSize) {
 			std::cerr << "Spotted a potential error: "
@@ -122,7 +142,7 @@ void DIMSUM::update(DIMitem_t item, DIMweight_t value) {
 	// Wait for maintenance to finish running if needed
 	if (!finishedMedian) {
 		if (copied2buffer < nPassive) {
-			do_some_copying();
+			do_some_copying(false);
 		}
 		else if (blocksLeftThisUpdate > 0) {
 			// block until update is finished.
@@ -132,10 +152,10 @@ void DIMSUM::update(DIMitem_t item, DIMweight_t value) {
 	}
 	else {
 		if (movedFromPassive < nPassive) {
-			do_some_moving();
+			do_some_moving(false);
 		}
 		else {
-			do_some_clearing();
+			do_some_clearing(false);
 		}
 	}
 }
@@ -188,6 +208,31 @@ int DIMSUM::maintenance() {
     return 0;
 }
 
+/**
+ * Completes the current maintenance before the tables are swapped.  The
+ * steps are normally spread over the updates, but the maintenance thread
+ * may not have been scheduled in time to find the median, as when it
+ * shares a core with the updates; then wait for it and do the rest here.
+ * Returns whether any of it was left.
+ */
+bool DIMSUM::finish_maintenance() {
+    bool late = !finishedMedian || copied2buffer < nPassive ||
+        movedFromPassive < nPassive || clearedFromPassive < passiveHashSize;
+    if (copied2buffer < nPassive) {
+        do_some_copying(true);
+    }
+    while (!finishedMedian) {
+        std::this_thread::yield();
+    }
+    if (movedFromPassive < nPassive) {
+        do_some_moving(true);
+    }
+    if (clearedFromPassive < passiveHashSize) {
+        do_some_clearing(true);
+    }
+    return late;
+}
+
 void DIMSUM::restart_maintenance() {
     // switch counter arrays and zero out the active array
     #if DIMSUM_VERBOSE
@@ -243,12 +288,12 @@ void DIMSUM::do_update(DIMitem_t item, DIMweight_t value) {
 	}
 }
 
-void DIMSUM::do_some_copying() {
+void DIMSUM::do_some_copying(bool all) {
 	int updatesLeft = activeSize - nActive;
 	assert(movedFromPassive == 0);
 	assert(updatesLeft >= 0);
 	stepsLeft = (passiveHashSize + BLOCK_MULTIPLIER * nPassive) + 1 - copied2buffer;
-	int stepsLeftThisUpdate = stepsLeft / (updatesLeft + 1);
+	int stepsLeftThisUpdate = all ? stepsLeft : stepsLeft / (updatesLeft + 1);
 	int k = nPassive - ceil(1 / epsilon);
 	if (k >= 0) {
 		for (int i = 0; i < stepsLeftThisUpdate; i++) {
@@ -276,10 +321,10 @@ void DIMSUM::do_some_copying() {
  * the quantile will get cleared out, not get moved to the active table, and
  * get overwritten later.
  */
-void DIMSUM::do_some_moving() {
+void DIMSUM::do_some_moving(bool all) {
 	int updatesLeft = activeSize - nActive - left2move;
 	stepsLeft = passiveSize + nPassive - movedFromPassive;
-	int steps_left_this_update = stepsLeft / (updatesLeft+1);
+	int steps_left_this_update = all ? stepsLeft : stepsLeft / (updatesLeft+1);
 	int largerThanQuantile = 0;
 	for (int i = 0; i < steps_left_this_update; i++) {
 		if (passiveCounters[movedFromPassive].count > quantile) {
@@ -312,13 +357,13 @@ void DIMSUM::do_some_moving() {
 	}
 }
 
-void DIMSUM::do_some_clearing() {
+void DIMSUM::do_some_clearing(bool all) {
     int updatesLeft = activeSize - nActive;
     assert(movedFromPassive == nPassive);
 	assert(left2move == 0);
 	assert(updatesLeft >= 0);
 	stepsLeft = passiveHashSize - clearedFromPassive;
-	int steps_left_this_update = stepsLeft / (updatesLeft + 1);
+	int steps_left_this_update = all ? stepsLeft : stepsLeft / (updatesLeft + 1);
 	for (int i = 0; i < steps_left_this_update; i++) {
 		passiveHashtable[clearedFromPassive] = NULL;
 		clearedFromPassive++;
@@ -598,8 +643,6 @@ void DIMSUM::destroy_passive() {
 	#if DIMSUM_VERBOSE
         std::cerr << "Destroying the read-only passive table" << std::endl;
     #endif
-    all_done = true;
-    maintenance_step_mutex.unlock();
     free(passiveHashtable);
     free(passiveCounters);
 }
@@ -5,6 +5,7 @@
  */
 #include "prng.h"
 #include <mutex>
+#include <atomic>
 #include <thread>
 #include <algorithm>
 
@@ -37,7 +38,9 @@
 
 class DIMSUM {
 
-    DIMweight_t n;
+    friend class DIMSUMBench; // the microbenchmarks in bench.cc
+
+    int64_t n; // total weight of the updates
 
     int hasha, hashb;
     int countersize, maxMaintenanceTime;
@@ -62,15 +65,24 @@ class DIMSUM {
     int blocksLeft, blocksLeftThisUpdate;
     int left2move, copied2buffer;
     int stepsLeft, movedFromPassive, clearedFromPassive;
-    bool finishedMedian;
+    std::atomic<bool> finishedMedian; // set by the maintenance thread
 
     // cleanup code for maintenance
     bool all_done;
+    std::thread maintenance_thread;
 
 public:
     DIMSUM(float, float);
     ~DIMSUM();
 
+    // number of counters in each table, and slots of its hashtable
+    static int table_size(float, float);
+    static int hash_size(float, float);
+
+    // times the active table filled up, and of those, times the updates
+    // had to finish the maintenance because it was not done yet
+    uint64_t swaps, stalls;
+
     // user methods
     void update(DIMitem_t, DIMweight_t);
     int size();
@@ -104,12 +116,14 @@ private:
     // maintenance threads stuff
     int maintenance();
     void restart_maintenance();
+    bool finish_maintenance();
     inline void finish_step();
 
     void do_update(DIMitem_t, DIMweight_t);
-    void do_some_copying();
-    void do_some_clearing();
-    void do_some_moving();
+    // each does its share of the steps for one update, or all that are left
+    void do_some_copying(bool);
+    void do_some_clearing(bool);
+    void do_some_moving(bool);
 
 
     // internal editing functions for adding/updating
@@ -126,7 +140,7 @@ private:
 
 class DIMSUMpp {
 
-    DIMweight_t n;
+    int64_t n; // total weight of the updates
 
     int hasha, hashb;
     int countersize, maxMaintenanceTime;
@@ -170,6 +184,10 @@ public:
     DIMSUMpp(float, float);
     ~DIMSUMpp();
 
+    // times the active table filled up, and of those, times the update had
+    // to run the maintenance: it is not deamortized here, so that is all
+    uint64_t swaps, stalls;
+
     // User callable functions
     void update(DIMitem_t, DIMweight_t);
     int size();
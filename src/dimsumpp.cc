@@ -39,7 +39,7 @@ DIMSUMpp::DIMSUMpp(float ep, float g) {
 	// randomly later. Currently hardcoded for paper reproduciblity.
     hasha = 151261303;
 	hashb = 6722461; 
-    n = (DIMweight_t) 0;
+    n = 0;
 
     init_active();
     init_passive();
@@ -52,6 +52,8 @@ DIMSUMpp::DIMSUMpp(float ep, float g) {
     // Allocate the number of spaces to our buffer for
     // finding the topk and quantile stuff
     quantile = 0;
+    swaps = 0;
+    stalls = 0;
 
     // Allocate all of the shared parameters used during maintenance
     // blocksLeft = 0;
@@ -180,6 +182,9 @@ void DIMSUMpp::restart_maintenance() {
     #if DIM_DEBUG
     std::cerr << "Starting the maintenance..." << std::endl;
     #endif
+    // the whole maintenance runs below, within the update
+    swaps++;
+    stalls++;
     // switch the active counter and the small passive counter
     std::swap(activeCounters, smallPassiveCounters);
     std::swap(nActive, nSmallPassive);
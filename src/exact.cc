@@ -0,0 +1,237 @@
+/*
+ * Exact ground truth counter, see exact.h.
+ *
+ * Each partition is an open addressing table with linear probing, grown
+ * when half full.  A key's hash picks its partition with the top bits and
+ * its slot with the low bits.  A thread scatters the entries of its slice
+ * into buffers of its own, one per partition; the thread that counts a
+ * partition then reads them slice by slice, in stream order, so the
+ * tables and heavy sets come out as if one thread had added the batch.
+ */
+#include "exact.h"
+
+#include <algorithm>
+#include <limits>
+
+#define EXACT_INITSIZE 1024 // slots per partition to start with
+
+static inline uint64_t ExactHash(uint64_t key) {
+	// the splitmix64 finalizer: every key bit reaches every hash bit
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return key;
+}
+
+ExactCounter::ExactCounter(int threads)
+	: parts(1 << EXACT_PARTBITS), thresh(std::numeric_limits<uint64_t>::max()),
+	  total(0), threads(threads < 1 ? 1 : threads), round(0), pending(0), stop(false) {
+	for (Part& p : parts) {
+		p.keys.assign(EXACT_INITSIZE, 0);
+		p.counts.assign(EXACT_INITSIZE, 0);
+		p.size = 0;
+	}
+}
+
+ExactCounter::~ExactCounter() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stop = true;
+	}
+	ready.notify_all();
+	for (auto& th : pool) th.join();
+}
+
+void ExactCounter::Parallel(const std::function<void(int)>& f) {
+	if (pool.empty()) {
+		for (int t = 1; t < threads; ++t) pool.push_back(std::thread(&ExactCounter::Work, this, t));
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		job = f;
+		pending = threads - 1;
+		++round;
+	}
+	ready.notify_all();
+	f(0);
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [this] { return pending == 0; });
+}
+
+void ExactCounter::Work(int t) {
+	uint64_t seen = 0;
+	for (;;) {
+		std::function<void(int)> f;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			ready.wait(guard, [this, seen] { return stop || round != seen; });
+			if (stop) return;
+			seen = round;
+			f = job;
+		}
+		f(t);
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (--pending == 0) done.notify_one();
+		}
+	}
+}
+
+void ExactCounter::Grow(Part& p) {
+	std::vector<uint64_t> keys, counts;
+	keys.swap(p.keys);
+	counts.swap(p.counts);
+	p.keys.assign(2 * keys.size(), 0);
+	p.counts.assign(2 * counts.size(), 0);
+	size_t mask = p.keys.size() - 1;
+	for (size_t i = 0; i < keys.size(); ++i) {
+		if (counts[i] == 0) continue;
+		size_t s = ExactHash(keys[i]) & mask;
+		while (p.counts[s] != 0) s = (s + 1) & mask;
+		p.keys[s] = keys[i];
+		p.counts[s] = counts[i];
+	}
+}
+
+inline void ExactCounter::Insert(Part& p, uint64_t key, uint64_t hash, uint64_t value) {
+	size_t mask = p.keys.size() - 1;
+	size_t s = hash & mask;
+	while (p.counts[s] != 0 && p.keys[s] != key) s = (s + 1) & mask;
+	uint64_t old = p.counts[s];
+	if (old == 0) {
+		if (2 * (p.size + 1) > p.keys.size()) {
+			Grow(p);
+			Insert(p, key, hash, value);
+			return;
+		}
+		p.keys[s] = key;
+		++p.size;
+	}
+	p.counts[s] = old + value;
+	// an item joins the heavy set as it first reaches the threshold
+	if (old < thresh && old + value >= thresh) p.heavy.push_back(key);
+}
+
+template <class K>
+void ExactCounter::Scatter(int t, const K* keys, const uint32_t* values, size_t n) {
+	// thread t takes the t-th slice of the round
+	size_t from = n * t / threads, to = n * (t + 1) / threads;
+	std::vector<Entry>* out = &scattered[(size_t) t << EXACT_PARTBITS];
+	for (size_t i = from; i < to; ++i) {
+		uint64_t value = values ? values[i] : 1;
+		if (value == 0) continue;
+		uint64_t h = ExactHash(keys[i]);
+		out[h >> (64 - EXACT_PARTBITS)].push_back(Entry{keys[i], h, value});
+	}
+}
+
+void ExactCounter::Gather(int t) {
+	// thread t counts every threads-th partition, from the slices in order
+	for (size_t part = t; part < parts.size(); part += threads) {
+		for (int s = 0; s < threads; ++s) {
+			std::vector<Entry>& in = scattered[((size_t) s << EXACT_PARTBITS) + part];
+			for (const Entry& e : in) Insert(parts[part], e.key, e.hash, e.value);
+			in.clear();
+		}
+	}
+}
+
+template <class K>
+void ExactCounter::AddBatch(const K* keys, const uint32_t* values, size_t n) {
+	if (threads == 1 || n < EXACT_PARALLEL_MIN) {
+		for (size_t i = 0; i < n; ++i) {
+			uint64_t value = values ? values[i] : 1;
+			if (value == 0) continue;
+			uint64_t h = ExactHash(keys[i]);
+			Insert(parts[h >> (64 - EXACT_PARTBITS)], keys[i], h, value);
+		}
+	} else {
+		// a round at a time, so that the scattered entries stay small
+		scattered.resize((size_t) threads << EXACT_PARTBITS);
+		for (size_t from = 0; from < n; from += EXACT_ROUND) {
+			size_t m = std::min<size_t>(EXACT_ROUND, n - from);
+			const uint32_t* v = values ? values + from : NULL;
+			Parallel([&](int t) { Scatter(t, keys + from, v, m); });
+			Parallel([&](int t) { Gather(t); });
+		}
+	}
+	if (values) {
+		for (size_t i = 0; i < n; ++i) total += values[i];
+	} else {
+		total += n;
+	}
+}
+
+void ExactCounter::Add(const uint32_t* keys, const uint32_t* values, size_t n) {
+	AddBatch(keys, values, n);
+}
+
+void ExactCounter::Add(const uint64_t* keys, const uint32_t* values, size_t n) {
+	AddBatch(keys, values, n);
+}
+
+uint64_t ExactCounter::Count(uint64_t key) const {
+	uint64_t h = ExactHash(key);
+	const Part& p = parts[h >> (64 - EXACT_PARTBITS)];
+	size_t mask = p.keys.size() - 1;
+	size_t s = h & mask;
+	while (p.counts[s] != 0) {
+		if (p.keys[s] == key) return p.counts[s];
+		s = (s + 1) & mask;
+	}
+	return 0;
+}
+
+void ExactCounter::Rebuild() {
+	// a lower threshold than before: items between the two were never
+	// added, so rescan the tables
+	for (Part& p : parts) {
+		p.heavy.clear();
+		for (size_t i = 0; i < p.counts.size(); ++i) {
+			if (p.counts[i] != 0 && p.counts[i] >= thresh) p.heavy.push_back(p.keys[i]);
+		}
+	}
+}
+
+void ExactCounter::SetThreshold(uint64_t t) {
+	if (t < thresh) {
+		thresh = t;
+		Rebuild();
+		return;
+	}
+	thresh = t;
+	// drop the items the threshold has passed, so that each can join
+	// again, once, when it reaches the threshold
+	for (Part& p : parts) {
+		size_t kept = 0;
+		for (uint64_t key : p.heavy) {
+			if (Count(key) >= thresh) p.heavy[kept++] = key;
+		}
+		p.heavy.resize(kept);
+	}
+}
+
+const std::vector<uint64_t>& ExactCounter::Heavy(uint64_t t) {
+	SetThreshold(t);
+	result.clear();
+	for (const Part& p : parts) {
+		result.insert(result.end(), p.heavy.begin(), p.heavy.end());
+	}
+	return result;
+}
+
+size_t ExactCounter::Distinct() const {
+	size_t d = 0;
+	for (const Part& p : parts) d += p.size;
+	return d;
+}
+
+size_t ExactCounter::Size() const {
+	size_t s = sizeof(ExactCounter);
+	for (const Part& p : parts) {
+		s += (p.keys.capacity() + p.counts.capacity() + p.heavy.capacity()) * sizeof(uint64_t);
+	}
+	return s;
+}
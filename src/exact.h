@@ -0,0 +1,115 @@
+/*
+ * Exact ground truth for the heavy hitter benchmarks.  Counts every key of
+ * the stream in a hash table split into partitions.  A large batch is
+ * spread over a pool of threads in two passes: each thread hashes its own
+ * slice of the batch once and scatters it by partition, then each
+ * partition is counted by one thread, so no locks are needed and every
+ * key is hashed once whatever the number of threads.  Keys may be any 32
+ * or 64 bit value.
+ *
+ * The items whose count is at least a threshold are kept in a heavy set
+ * as the stream goes by, so finding the exact heavy hitters after a run
+ * costs time in the number of heavy items rather than in the domain.
+ */
+#ifndef EXACT_h
+#define EXACT_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#define EXACT_PARTBITS 6 // 64 partitions
+#define EXACT_PARALLEL_MIN (1<<16) // smaller batches are added by one thread
+#define EXACT_ROUND (1<<20) // keys scattered and counted at a time
+
+class ExactCounter {
+public:
+	ExactCounter(int threads = 1);
+	~ExactCounter();
+
+	/**
+	 * Sets the threshold of the heavy set; items reaching it from now on
+	 * are added.  Thresholds normally only grow with the stream.
+	 */
+	void SetThreshold(uint64_t thresh);
+
+	/**
+	 * Adds one batch of keys, each with its value, or with 1 if values is
+	 * NULL.  Keys with a zero value are ignored.
+	 */
+	void Add(const uint32_t* keys, const uint32_t* values, size_t n);
+	void Add(const uint64_t* keys, const uint32_t* values, size_t n);
+
+	uint64_t Count(uint64_t key) const;
+
+	/**
+	 * Returns the keys whose count is at least thresh, and makes thresh
+	 * the threshold of the heavy set.
+	 */
+	const std::vector<uint64_t>& Heavy(uint64_t thresh);
+
+	/**
+	 * Calls f(key, count) for every key seen so far.
+	 */
+	template <class F> void ForEach(F f) const {
+		for (const Part& p : parts) {
+			for (size_t i = 0; i < p.counts.size(); ++i) {
+				if (p.counts[i] != 0) f(p.keys[i], p.counts[i]);
+			}
+		}
+	}
+
+	size_t Distinct() const;
+	uint64_t Total() const { return total; }
+	size_t Size() const;
+
+private:
+	struct Part {
+		std::vector<uint64_t> keys;
+		std::vector<uint64_t> counts; // 0 marks an empty slot
+		std::vector<uint64_t> heavy; // may hold items since fallen below
+		size_t size;
+	};
+
+	struct Entry {
+		uint64_t key, hash, value;
+	};
+
+	template <class K> void AddBatch(const K* keys, const uint32_t* values, size_t n);
+	template <class K> void Scatter(int t, const K* keys, const uint32_t* values, size_t n);
+	void Gather(int t);
+	void Insert(Part& p, uint64_t key, uint64_t hash, uint64_t value);
+	void Grow(Part& p);
+	void Rebuild();
+
+	/**
+	 * Runs f(t) for t = 0 .. threads-1, f(0) on the calling thread and the
+	 * rest on the pool, which is started on first use; returns when all
+	 * are done.
+	 */
+	void Parallel(const std::function<void(int)>& f);
+	void Work(int t);
+
+	std::vector<Part> parts;
+	std::vector<uint64_t> result;
+	uint64_t thresh;
+	uint64_t total;
+	int threads;
+
+	// the entries each thread scattered to each partition, thread-major
+	std::vector<std::vector<Entry> > scattered;
+
+	std::vector<std::thread> pool;
+	std::function<void(int)> job;
+	uint64_t round; // bumped for every job handed to the pool
+	int pending; // pool threads still running the job
+	bool stop;
+	std::mutex lock;
+	std::condition_variable ready, done;
+};
+
+#endif
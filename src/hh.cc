@@ -8,6 +8,13 @@ Handles the evaluation of different
 #define VERBOSE_EXACT false
 
 #include "countmin.h"  // naive count min sketch
+#include "ccfc.h"
+#include "lossycount.h"
+#include "trace.h"
+#include "exact.h"
+#include "report.h"
+#include "perfcount.h"
+#include "workload.h"
 
 // wfu implemeneted new c++ dimsum stuff
 #include "dimsum.h"
@@ -17,6 +24,11 @@ Handles the evaluation of different
 #include <fstream>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <pthread.h>
 #include <sys/time.h>
 #include <cstring>
 
@@ -24,17 +36,76 @@ Handles the evaluation of different
 using Clock = std::chrono::steady_clock;
 using std::chrono::time_point;
 using std::chrono::duration_cast;
-using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
 
 
 /******************************************************************/
+// accuracy of one run's heavy hitters, in percent and relative error
+struct RunStats {
+	double R, P, F, F2;
+};
+
+/**
+ * Histogram of update latencies: exact up to LATENCY_EXACT ns, then
+ * LATENCY_SUB bins for each power of two, so that the quantiles it gives
+ * are within 1/LATENCY_SUB of the truth at any scale.
+ */
+#define LATENCY_EXACT 64
+#define LATENCY_SUB 16
+#define LATENCY_BINS (LATENCY_EXACT + 58 * LATENCY_SUB)
+
+class Latency {
+public:
+	Latency() : count(0), max(0), bins(LATENCY_BINS, 0) {}
+
+	void Add(uint64_t ns) {
+		int bin;
+		if (ns < LATENCY_EXACT) bin = (int) ns;
+		else {
+			int e = 63 - __builtin_clzll(ns); // 2^e <= ns < 2^(e+1), e >= 6
+			bin = LATENCY_EXACT + (e - 6) * LATENCY_SUB + (int) ((ns >> (e - 4)) & (LATENCY_SUB - 1));
+		}
+		bins[bin]++;
+		count++;
+		if (ns > max) max = ns;
+	}
+
+	/**
+	 * Returns the upper end of the bin holding the q-th quantile, NAN if
+	 * nothing was added.
+	 */
+	double Quantile(double q) const {
+		if (count == 0) return NAN;
+		uint64_t rank = (uint64_t) ceil(q * count), seen = 0;
+		for (int bin = 0; bin < LATENCY_BINS; ++bin) {
+			seen += bins[bin];
+			if (seen >= rank && seen > 0) {
+				if (bin < LATENCY_EXACT) return bin;
+				int e = (bin - LATENCY_EXACT) / LATENCY_SUB + 6;
+				uint64_t low = ((uint64_t) LATENCY_SUB + (bin - LATENCY_EXACT) % LATENCY_SUB) << (e - 4);
+				return (double) std::min<uint64_t>(low + ((uint64_t) 1 << (e - 4)) - 1, max);
+			}
+		}
+		return (double) max;
+	}
+
+	uint64_t count, max;
+	std::vector<uint64_t> bins;
+};
+
 class Stats {
 public:
-	Stats() : dU(0.0), dQ(0.0), dP(0.0), dR(0.0), dF(0.0), dF2(0.0) {}
+	Stats() : dU(0.0), dQ(0.0), dP(0.0), dR(0.0), dF(0.0), dF2(0.0) {
+		for (int e = 0; e < PERF_EVENTS; ++e) cU[e] = cQ[e] = 0.0;
+	}
 
-	double dU, dQ;
+	double dU, dQ; // total update and query time in nanoseconds
+	double cU[PERF_EVENTS], cQ[PERF_EVENTS]; // hardware events in updates and queries
 	double dP, dR, dF, dF2;
 	std::multiset<double> P, R, F, F2;
+	std::vector<double> U, Q; // updates/ms and query microseconds of each run
+	Latency L; // of single updates, when they are timed one by one
+	std::vector<RunStats> runs;
 };
 
 void usage() {
@@ -42,24 +113,38 @@ void usage() {
 		<< "Usage: graham"                   << std::endl
 		<< "\t-np		number of packets"   << std::endl
 		<< "\t-r		number of runs"      << std::endl
-		<< "\t-phi		phi"                 << std::endl
+		<< "\t-phi		phi, or a comma separated list to sweep" << std::endl
 		<< "\t-d		depth"               << std::endl
 		<< "\t-g		granularity"         << std::endl
-		<< "\t-gamma    DIM-SUM coefficient" << std::endl
-		<< "\t-z        skew"                << std::endl
-		<< std::endl;
+		<< "\t-gamma    DIM-SUM coefficient, or a list" << std::endl
+		<< "\t-z        skew, or a list"     << std::endl
+		<< "\t-j        configurations of a sweep run at once, on pinned cores" << std::endl
+		<< "\t-perf     count cycles, instructions, cache, TLB and branch misses" << std::endl
+		<< "\t-latency  time every update on its own, for the tail latency" << std::endl
+		<< "\t-f        trace file, text, binary or pcap (\"\" for synthetic)" << std::endl
+		<< "\t-key      id of a captured packet: src, dst, srcport or flow" << std::endl
+		<< "\t-cmsweep  Count-Min memory vs error sweep" << std::endl
+		<< "\t-stream   replay the trace, or generate the synthetic one, in chunks" << std::endl
+		<< "\t-chunk    packets per streamed chunk, each one a run" << std::endl
+		<< "\t-algs     comma separated list of algorithms, or all" << std::endl
+		<< "\t          (ALS,DSpp,DS,CM,CMCU,CMH,CCFC,LC,LCD,LCL,LCU)" << std::endl
+		<< "\t-format   results as a table, json (one line per record) or csv" << std::endl
+		<< "\t-o        file for json or csv results (standard output)" << std::endl
+		<< "Synthetic traces:" << std::endl;
+	Workload_Usage();
+	std::cerr << std::endl;
 }
 
 
 /**
- * Stops the timer and returns the time elapsed in milliseconds.
+ * Stops the timer and returns the time elapsed in nanoseconds.
  * 		start = Clock::now();
  *      f();
  * 		uint64_t elapsed = StopTheClock(start);
  */
 uint64_t StopTheClock(time_point<Clock> &start) {
 	auto end = Clock::now();
-    milliseconds diff = duration_cast<milliseconds>(end - start);
+    nanoseconds diff = duration_cast<nanoseconds>(end - start);
     return static_cast<uint64_t>(diff.count());
 }
 
@@ -68,7 +153,7 @@ uint64_t StopTheClock(time_point<Clock> &start) {
  * actual actual values (since our algorithms overestimate)
  */
 void CheckOutput(std::map<uint32_t, uint32_t>& res, uint64_t thresh, size_t hh,
-				 Stats& S, const std::vector<uint32_t>& exact) {
+				 Stats& S, const ExactCounter& exact) {
 	/*
 	std::cout << "Exact heavy hitter ids" << std::endl;
 	for (auto hitter : exact) {
@@ -86,6 +171,8 @@ void CheckOutput(std::map<uint32_t, uint32_t>& res, uint64_t thresh, size_t hh,
 		} else {
 			S.R.insert(0.0);
 		}
+		RunStats run = {hh == 0 ? 100.0 : 0.0, 100.0, 0.0, 0.0};
+		S.runs.push_back(run);
 		return;
 	}
 
@@ -96,15 +183,14 @@ void CheckOutput(std::map<uint32_t, uint32_t>& res, uint64_t thresh, size_t hh,
 
 	std::map<uint32_t, uint32_t>::iterator it;
 	for (it = res.begin(); it != res.end(); ++it) {
-		if (exact[it->first] >= thresh) {
+		uint64_t ex = exact.Count(it->first);
+		if (ex >= thresh) {
 			++correct;
-			uint32_t ex = exact[it->first];
 			double diff = (ex > it->second) ? ex - it->second : it->second - ex;
 			e += diff / ex;
 		}
 		else {
 			++falsepositives;
-			uint32_t ex = exact[it->first];
 			double diff = (ex > it->second) ? ex - it->second : it->second - ex;
 			e2 += diff / ex;
 		}
@@ -135,6 +221,8 @@ void CheckOutput(std::map<uint32_t, uint32_t>& res, uint64_t thresh, size_t hh,
 	S.dR += r;
 	S.P.insert(p);
 	S.dP += p;
+	RunStats run = {r, p, e, e2};
+	S.runs.push_back(run);
 }
 
 /**
@@ -149,76 +237,753 @@ void PrintTimes(std::string title, std::vector<uint64_t> times) {
 }
 
 
+/**
+ * Returns the mean of the samples and sets ci to the half width of its 95%
+ * confidence interval, from Student's t distribution; 0 if there are fewer
+ * than two samples.
+ */
+double MeanCI(const std::vector<double>& x, double& ci) {
+	// two sided 97.5th percentiles of t for 1 to 30 degrees of freedom
+	static const double t975[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447,
+		2.365, 2.306, 2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+		2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056,
+		2.052, 2.048, 2.045, 2.042};
+	double mean = 0.0, var = 0.0;
+	size_t n = x.size();
+
+	ci = 0.0;
+	if (n == 0) return 0.0;
+	for (double v : x) mean += v;
+	mean /= n;
+	if (n < 2) return mean;
+	for (double v : x) var += (v - mean) * (v - mean);
+	var /= n - 1;
+	ci = (n - 1 <= 30 ? t975[n - 2] : 1.960) * sqrt(var / n);
+	return mean;
+}
+
+/**
+ * Returns the q-th quantile of a sample, -1 if it is empty.
+ */
+double Quantile(const std::multiset<double>& x, double q) {
+	if (x.empty()) return -1.0;
+	std::multiset<double>::const_iterator it = x.begin();
+	std::advance(it, (size_t) (x.size() * q));
+	return *it;
+}
+
 /**
  * Pretty prints our statistics class.
  */
-void PrintOutput(std::string title, size_t size, const Stats& S, size_t u32NumberOfPackets) {
-	double p5th = -1.0, p95th = -1.0, r5th = -1.0, r95th = -1.0, f5th = -1.0, f95th = -1.0, f25th = -1.0, f295th = -1.0;
-	size_t i5, i95;
-	std::multiset<double>::const_iterator it;
-
-	if (! S.P.empty()) {
-		it = S.P.begin();
-		i5 = (size_t) (S.P.size() * 0.05);
-		for (size_t i = 0; i < i5; ++i) ++it;
-		p5th = *it;
-		i95 = (size_t) (S.P.size() * 0.95);
-		for (size_t i = 0; i < (i95 - i5); ++i) ++it;
-		p95th = *it;
-	}
-
-	if (! S.R.empty()) {
-		it = S.R.begin();
-		i5 = S.R.size() * 0.05;
-		for (size_t i = 0; i < i5; ++i) ++it;
-		r5th = *it;
-		i95 = S.R.size() * 0.95;
-		for (size_t i = 0; i < (i95 - i5); ++i) ++it;
-		r95th = *it;
-	}
-
-	if (! S.F.empty()) {
-		it = S.F.begin();
-		i5 = S.F.size() * 0.05;
-		for (size_t i = 0; i < i5; ++i) ++it;
-		f5th = *it;
-		i95 = S.F.size() * 0.95;
-		for (size_t i = 0; i < (i95 - i5); ++i) ++it;
-		f95th = *it;
-	}
-
-	if (! S.F2.empty()) {
-		it = S.F2.begin();
-		i5 = S.F2.size() * 0.05;
-		for (size_t i = 0; i < i5; ++i) ++it;
-		f25th = *it;
-		i95 = S.F2.size() * 0.95;
-		for (size_t i = 0; i < (i95 - i5); ++i) ++it;
-		f295th = *it;
-	}
-	
+void PrintOutput(std::string title, size_t size, const Stats& S, size_t u32NumberOfPackets,
+				 FILE* out = stdout) {
+	double r5th = Quantile(S.R, 0.05), r95th = Quantile(S.R, 0.95);
+	double p5th = Quantile(S.P, 0.05), p95th = Quantile(S.P, 0.95);
+	double f5th = Quantile(S.F, 0.05), f95th = Quantile(S.F, 0.95);
+	double f25th = Quantile(S.F2, 0.05), f295th = Quantile(S.F2, 0.95);
+
 	if (S.dU <= 0) {
-		printf("Error! Total update time %f not positive\n", S.dU);
+		fprintf(out, "Error! Total update time %f not positive\n", S.dU);
 	}
+
+	// the per run rates and latencies go last, after the columns the
+	// plotting scripts read
+	double uci, qci;
+	MeanCI(S.U, uci);
+	double q = MeanCI(S.Q, qci);
 	
-	printf("%s\t%1.2f\t%zd\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\n",
-		title.c_str(), u32NumberOfPackets / S.dU, size,
+	fprintf(out, "%s\t%1.2f\t%zd\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\t%1.2f\n",
+		title.c_str(), u32NumberOfPackets / (S.dU / 1e6), size,
 		(S.R.size() > 0) ? S.dR / S.R.size():0, r5th, r95th,
 		(S.P.size() > 0) ? S.dP / S.P.size():0, p5th, p95th,
 		(S.F.size() > 0) ? S.dF / S.F.size():0, f5th, f95th,
-		(S.F2.size()> 0) ? S.dF2 / S.F2.size():0, f25th, f295th
+		(S.F2.size()> 0) ? S.dF2 / S.F2.size():0, f25th, f295th,
+		uci, q, qci
 	);
 }
 
 /**
- * Uses the slow algorithm to find which streams have above a certain threshold.
+ * Prints the hardware events of an engine per update and per query, with
+ * a dash for the events the machine does not count.
+ */
+void PrintCounters(std::string title, const Stats& S, size_t updates, size_t queries,
+				   const PerfCounters& perf, FILE* out = stdout) {
+	fprintf(out, "%s", title.c_str());
+	for (int per = 0; per < 2; ++per) {
+		const double* c = per ? S.cQ : S.cU;
+		double n = per ? queries : updates;
+		for (int e = 0; e < PERF_EVENTS; ++e) {
+			if (perf.Available(e) && n > 0) fprintf(out, "\t%1.2f", c[e] / n);
+			else fprintf(out, "\t-");
+		}
+		if (perf.Available(PERF_CYCLES) && perf.Available(PERF_INSTRUCTIONS) && c[PERF_CYCLES] > 0)
+			fprintf(out, "\t%1.2f", c[PERF_INSTRUCTIONS] / c[PERF_CYCLES]);
+		else fprintf(out, "\t-");
+	}
+	fprintf(out, "\n");
+}
+
+/**
+ * Prints the quantiles of an engine's update latency, and how often
+ * DIM-SUM's updates had to finish its maintenance.
+ */
+void PrintLatency(std::string title, const Stats& S, int64_t swaps, int64_t stalls,
+				  FILE* out = stdout) {
+	fprintf(out, "%s\t%1.0f\t%1.0f\t%1.0f\t%1.0f\t%1.0f\t%llu", title.c_str(),
+		S.L.Quantile(0.5), S.L.Quantile(0.99), S.L.Quantile(0.999), S.L.Quantile(0.9999),
+		S.L.Quantile(0.99999), (unsigned long long) S.L.max);
+	if (swaps >= 0) fprintf(out, "\t%lld\t%lld\n", (long long) swaps, (long long) stalls);
+	else fprintf(out, "\t-\t-\n");
+}
+
+/**
+ * Writes one record for each run of an engine and one for the whole
+ * experiment.  Every record has the same fields, so that a CSV report has
+ * one header; those that mean nothing for a single run are left empty.
  */
-size_t RunExact(uint64_t thresh, std::vector<uint32_t>& exact) {
-	size_t hh = 0;
-	for (size_t i = 0; i < exact.size(); ++i) {
-		if (exact[i] >= thresh) ++hh;
+void ReportOutput(Report& rep, std::string title, size_t size, const Stats& S,
+				  const std::vector<uint64_t>& T, const std::vector<size_t>& runPackets,
+				  const PerfCounters* perf, bool latency, int64_t swaps, int64_t stalls) {
+	const double none = NAN;
+	auto Fields = [&](const char* record, double run, uint64_t packets, double rate,
+					  double update, double query, const RunStats& acc) {
+		rep.Field("record", std::string(record));
+		rep.Field("alg", title);
+		rep.Field("run", run);
+		rep.Field("packets", packets);
+		rep.Field("space", (uint64_t) size);
+		rep.Field("updates_per_ms", rate);
+		rep.Field("update_ns", update);
+		rep.Field("query_us", query);
+		rep.Field("recall", acc.R);
+		rep.Field("precision", acc.P);
+		rep.Field("freq_re", acc.F);
+		rep.Field("fp_re", acc.F2);
+	};
+	auto Spread = [&](const std::string& name, const std::multiset<double>& x) {
+		rep.Field(name + "_p5", x.empty() ? none : Quantile(x, 0.05));
+		rep.Field(name + "_p50", x.empty() ? none : Quantile(x, 0.5));
+		rep.Field(name + "_p95", x.empty() ? none : Quantile(x, 0.95));
+	};
+	auto NoSpread = [&](const std::string& name) {
+		rep.Field(name + "_p5", none);
+		rep.Field(name + "_p50", none);
+		rep.Field(name + "_p95", none);
+	};
+	const char* spread[] = {"updates_per_ms", "query_us", "recall", "precision",
+							"freq_re", "fp_re"};
+	const char* tail[] = {"p50", "p99", "p999", "p9999", "p99999"};
+	const double tailQ[] = {0.5, 0.99, 0.999, 0.9999, 0.99999};
+	// over the whole experiment only, like the hardware events
+	auto Tail = [&](bool summary) {
+		if (!latency) return;
+		for (int i = 0; i < 5; ++i) {
+			rep.Field(std::string("update_ns_") + tail[i], summary ? S.L.Quantile(tailQ[i]) : none);
+		}
+		rep.Field("update_ns_max", summary ? (double) S.L.max : none);
+		rep.Field("swaps", summary && swaps >= 0 ? (double) swaps : none);
+		rep.Field("stalls", summary && stalls >= 0 ? (double) stalls : none);
+	};
+
+	uint64_t packets = 0;
+	size_t runs = std::min(T.size(), S.runs.size());
+	for (size_t i = 0; i < runs && i < runPackets.size(); ++i) {
+		packets += runPackets[i];
+		double update = (double) T[i];
+		Fields("run", i + 1, runPackets[i],
+			   T[i] > 0 ? runPackets[i] * 1e6 / T[i] : none,
+			   runPackets[i] > 0 ? update / runPackets[i] : none,
+			   i < S.Q.size() ? S.Q[i] : none, S.runs[i]);
+		rep.Field("updates_per_ms_ci", none);
+		rep.Field("query_us_ci", none);
+		for (const char* name : spread) NoSpread(name);
+		if (perf) {
+			for (int e = 0; e < PERF_EVENTS; ++e) {
+				rep.Field(std::string(Perf_names[e]) + "_per_update", none);
+				rep.Field(std::string(Perf_names[e]) + "_per_query", none);
+			}
+		}
+		Tail(false);
+		rep.End();
+	}
+
+	double uci, qci;
+	MeanCI(S.U, uci);
+	double q = MeanCI(S.Q, qci);
+	RunStats mean = {
+		S.R.empty() ? none : S.dR / S.R.size(),
+		S.P.empty() ? none : S.dP / S.P.size(),
+		S.F.empty() ? none : S.dF / S.F.size(),
+		S.F2.empty() ? none : S.dF2 / S.F2.size()
+	};
+	Fields("summary", none, packets, S.dU > 0 ? packets / (S.dU / 1e6) : none,
+		   packets > 0 ? S.dU / packets : none, S.Q.empty() ? none : q, mean);
+	rep.Field("updates_per_ms_ci", uci);
+	rep.Field("query_us_ci", qci);
+	Spread("updates_per_ms", std::multiset<double>(S.U.begin(), S.U.end()));
+	Spread("query_us", std::multiset<double>(S.Q.begin(), S.Q.end()));
+	Spread("recall", S.R);
+	Spread("precision", S.P);
+	Spread("freq_re", S.F);
+	Spread("fp_re", S.F2);
+	if (perf) {
+		// counted over the whole experiment only
+		for (int e = 0; e < PERF_EVENTS; ++e) {
+			bool ok = perf->Available(e);
+			rep.Field(std::string(Perf_names[e]) + "_per_update",
+					  ok && packets > 0 ? S.cU[e] / packets : none);
+			rep.Field(std::string(Perf_names[e]) + "_per_query",
+					  ok && !S.Q.empty() ? S.cQ[e] / S.Q.size() : none);
+		}
+	}
+	Tail(true);
+	rep.End();
+}
+
+/**
+ * Count-Min only answers point queries, so build its heavy hitter report by
+ * querying every item that has appeared in the stream so far.
+ */
+std::map<uint32_t, uint32_t> CM_Output(CM_type* cm, uint64_t thresh,
+									   const ExactCounter& exact) {
+	std::map<uint32_t, uint32_t> res;
+	exact.ForEach([&](uint64_t item, uint64_t) {
+		int est = CM_PointEst(cm, item);
+		if (est >= 0 && (uint64_t) est >= thresh) {
+			res.insert(std::pair<uint32_t, uint32_t>(item, est));
+		}
+	});
+	return res;
+}
+
+/**
+ * Sweeps the counter memory given to Count-Min over a range of budgets and
+ * reports the error of the 32 bit sketch next to the compact 16 and 8 bit
+ * sketches, which fit two and four times the width into the same budget.
+ */
+void RunCMSweep(const uint32_t* data, const uint32_t* values, size_t stPackets,
+				double dPhi, uint32_t u32Depth) {
+	ExactCounter exact(std::thread::hardware_concurrency());
+	exact.Add(data, values, stPackets);
+	uint64_t total = exact.Total();
+	uint64_t thresh = static_cast<uint64_t>(floor(dPhi * total) + 1);
+	size_t base = (size_t) (2.0 / dPhi) * u32Depth * sizeof(int);
+	const double budgets[] = {0.125, 0.25, 0.5, 1.0, 2.0};
+	const int bits[] = {32, 16, 8};
+
+	printf("\nBudget\tMethod\tWidth\tSpace\tUpdates/ms\tAvg err/N\tMax err/N\tHH RE\n");
+	for (double budget : budgets) {
+		size_t bytes = (size_t) (base * budget);
+		for (int b : bits) {
+			int width = (int) (bytes / (u32Depth * (b / 8)));
+			if (width < 1) continue;
+			CM_type* cm = NULL;
+			CMC_type* cmc = NULL;
+			if (b == 32) cm = CM_Init(width, u32Depth, 0);
+			else cmc = CMC_Init(width, u32Depth, b, 0);
+
+			auto start = Clock::now();
+			if (cm) {
+				for (size_t i = 0; i < stPackets; ++i) CM_Update(cm, data[i], values[i]);
+			} else {
+				for (size_t i = 0; i < stPackets; ++i) CMC_Update(cmc, data[i], values[i]);
+			}
+			uint64_t t = StopTheClock(start);
+
+			double err = 0.0, maxerr = 0.0, hhre = 0.0;
+			size_t distinct = 0, hh = 0;
+			exact.ForEach([&](uint64_t item, uint64_t count) {
+				double est = cm ? CM_PointEst(cm, item) : CMC_PointEst(cmc, item);
+				double diff = est - count;
+				err += diff;
+				maxerr = std::max(maxerr, diff);
+				++distinct;
+				if (count >= thresh) {
+					hhre += diff / count;
+					++hh;
+				}
+			});
+			printf("%1.3f\t%s\t%d\t%d\t%1.2f\t%1.3e\t%1.3e\t%1.4f\n",
+				budget, b == 32 ? "CM" : (b == 16 ? "CMC16" : "CMC8"), width,
+				cm ? CM_Size(cm) : CMC_Size(cmc),
+				(t > 0) ? stPackets * 1e6 / t : 0.0,
+				(distinct > 0) ? err / distinct / total : 0.0, maxerr / total,
+				(hh > 0) ? hhre / hh : 0.0);
+			CM_Destroy(cm);
+			CMC_Destroy(cmc);
+		}
 	}
-	return hh;
+}
+
+/******************************************************************/
+
+/**
+ * Double buffered replay of a trace too large to preload, or generated as
+ * it goes.  A reader thread fills one chunk from the source while the
+ * caller runs the algorithms over the other, so only two chunks are ever
+ * held.  stalled is the time Next() spent waiting for the reader, which is
+ * left out of the update times.
+ */
+class ChunkStream {
+public:
+	// reads up to n packets into the buffers, 0 at the end of the trace
+	typedef std::function<size_t(uint32_t*, uint32_t*, size_t)> Source;
+
+	ChunkStream(Source source, size_t chunk)
+		: stalled(0), source(source), chunk(chunk), cur(-1), stop(false) {
+		for (int b = 0; b < 2; ++b) {
+			id[b].resize(chunk);
+			len[b].resize(chunk);
+			n[b] = 0;
+			full[b] = false;
+		}
+		worker = std::thread(&ChunkStream::Fill, this);
+	}
+
+	~ChunkStream() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stop = true;
+		}
+		ready.notify_all();
+		worker.join();
+	}
+
+	/**
+	 * Hands the previous chunk back to the reader and waits for the next.
+	 * Returns its number of packets, 0 at the end of the trace.
+	 */
+	size_t Next(const uint32_t** data, const uint32_t** values) {
+		std::unique_lock<std::mutex> guard(lock);
+		if (cur >= 0) {
+			full[cur] = false;
+			ready.notify_all();
+		}
+		cur = (cur + 1) & 1;
+		auto start = Clock::now();
+		ready.wait(guard, [this] { return full[cur]; });
+		stalled += StopTheClock(start);
+		*data = &id[cur][0];
+		*values = &len[cur][0];
+		return n[cur];
+	}
+
+	uint64_t stalled;
+
+private:
+	void Fill() {
+		for (int b = 0; ; b ^= 1) {
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				ready.wait(guard, [this, b] { return !full[b] || stop; });
+				if (stop) return;
+			}
+			size_t got = source(&id[b][0], &len[b][0], chunk);
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				n[b] = got;
+				full[b] = true;
+			}
+			ready.notify_all();
+			if (got == 0) return;
+		}
+	}
+
+	Source source;
+	size_t chunk;
+	std::vector<uint32_t> id[2], len[2];
+	size_t n[2];
+	bool full[2];
+	int cur;
+	bool stop;
+	std::mutex lock;
+	std::condition_variable ready;
+	std::thread worker;
+};
+
+/**
+ * One heavy hitter algorithm under test.  Run() is handed a whole run of the
+ * trace at a time, so the only indirection is one virtual call per run and
+ * the update loops inside are plain calls into each algorithm.
+ *
+ * Weighted engines count bytes; the rest (LC and LCD) only count
+ * packets and are checked against packet counts instead.
+ */
+class Engine {
+public:
+	Engine(std::string name, bool weighted) : name(name), weighted(weighted) {}
+	virtual ~Engine() {}
+
+	virtual void Run(const uint32_t* data, const uint32_t* values, size_t n) = 0;
+	virtual std::map<uint32_t, uint32_t> Output(uint64_t thresh,
+												const ExactCounter& exact) = 0;
+	virtual size_t Size() = 0;
+
+	// for DIM-SUM, the times its active table filled up and the times the
+	// update that found it full had to finish the maintenance; -1 elsewhere
+	virtual int64_t Swaps() { return -1; }
+	virtual int64_t Stalls() { return -1; }
+
+	std::string name;
+	bool weighted;
+	Stats S;
+	std::vector<uint64_t> T;
+};
+
+class ALSEngine : public Engine {
+public:
+	ALSEngine(double phi, double gamma) : Engine("ALS", true), als(ALS_Init(phi, gamma)) {}
+	~ALSEngine() { ALS_Destroy(als); }
+	void Run(const uint32_t* data, const uint32_t* values, size_t n) {
+		for (size_t i = 0; i < n; ++i) ALS_Update(als, data[i], values[i]);
+	}
+	std::map<uint32_t, uint32_t> Output(uint64_t thresh, const ExactCounter&) {
+		return ALS_Output(als, thresh);
+	}
+	size_t Size() { return ALS_Size(als); }
+	ALS_type* als;
+};
+
+class DSppEngine : public Engine {
+public:
+	DSppEngine(double phi, double gamma) : Engine("DSpp", true), ds(phi, gamma) {}
+	void Run(const uint32_t* data, const uint32_t* values, size_t n) {
+		for (size_t i = 0; i < n; ++i) ds.update(data[i], values[i]);
+	}
+	std::map<uint32_t, uint32_t> Output(uint64_t thresh, const ExactCounter&) {
+		return ds.output(thresh);
+	}
+	size_t Size() { return ds.size(); }
+	int64_t Swaps() { return (int64_t) ds.swaps; }
+	int64_t Stalls() { return (int64_t) ds.stalls; }
+	DIMSUMpp ds;
+};
+
+class DSEngine : public Engine {
+public:
+	DSEngine(double phi, double gamma) : Engine("DS", true), ds(phi, gamma) {}
+	void Run(const uint32_t* data, const uint32_t* values, size_t n) {
+		for (size_t i = 0; i < n; ++i) ds.update(data[i], values[i]);
+	}
+	std::map<uint32_t, uint32_t> Output(uint64_t thresh, const ExactCounter&) {
+		return ds.output(thresh);
+	}
+	size_t Size() { return ds.size(); }
+	int64_t Swaps() { return (int64_t) ds.swaps; }
+	int64_t Stalls() { return (int64_t) ds.stalls; }
+	DIMSUM ds;
+};
+
+class CMEngine : public Engine {
+public:
+	CMEngine(uint32_t width, uint32_t depth, bool cu)
+		: Engine(cu ? "CMCU" : "CM", true), cm(CM_Init(width, depth, 0)), cu(cu) {}
+	~CMEngine() { CM_Destroy(cm); }
+	void Run(const uint32_t* data, const uint32_t* values, size_t n) {
+		if (cu) {
+			for (size_t i = 0; i < n; ++i) CM_CUUpdate(cm, data[i], values[i]);
+		} else {
+			for (size_t i = 0; i < n; ++i) CM_Update(cm, data[i], values[i]);
+		}
+	}
+	std::map<uint32_t, uint32_t> Output(uint64_t thresh, const ExactCounter& exact) {
+		return CM_Output(cm, thresh, exact);
+	}
+	size_t Size() { return CM_Size(cm); }
+	CM_type* cm;
+	bool cu;
+};
+
+class CMHEngine : public Engine {
+public:
+	CMHEngine(uint32_t width, uint32_t depth, uint32_t gran)
+		: Engine("CMH", true), cmh(CMH_Init(width, depth, 32, gran)) {}
+	~CMHEngine() { CMH_Destroy(cmh); }
+	void Run(const uint32_t* data, const uint32_t* values, size_t n) {
+		for (size_t i = 0; i < n; ++i) CMH_Update(cmh, data[i], values[i]);
+	}
+	std::map<uint32_t, uint32_t> Output(uint64_t thresh, const ExactCounter&) {
+		return CMH_FindHH(cmh, thresh);
+	}
+	size_t Size() { return CMH_Size(cmh); }
+	CMH_type* cmh;
+};
+
+class CCFCEngine : public Engine {
+public:
+	CCFCEngine(uint32_t width, uint32_t depth, uint32_t gran)
+		: Engine("CCFC", true), ccfc(CCFC_Init(width, depth, 32, gran)) {}
+	~CCFCEngine() { CCFC_Destroy(ccfc); }
+	void Run(const uint32_t* data, const uint32_t* values, size_t n) {
+		for (size_t i = 0; i < n; ++i) CCFC_Update(ccfc, data[i], values[i]);
+	}
+	std::map<uint32_t, uint32_t> Output(uint64_t thresh, const ExactCounter&) {
+		return CCFC_Output(ccfc, thresh);
+	}
+	size_t Size() { return CCFC_Size(ccfc); }
+	CCFC_type* ccfc;
+};
+
+class LCEngine : public Engine {
+public:
+	LCEngine(double phi) : Engine("LC", false), lc(LC_Init(phi)) {}
+	~LCEngine() { LC_Destroy(lc); }
+	void Run(const uint32_t* data, const uint32_t*, size_t n) {
+		for (size_t i = 0; i < n; ++i) LC_Update(lc, data[i]);
+	}
+	std::map<uint32_t, uint32_t> Output(uint64_t thresh, const ExactCounter&) {
+		return LC_Output(lc, thresh);
+	}
+	size_t Size() { return LC_Size(lc); }
+	LC_type* lc;
+};
+
+class LCDEngine : public Engine {
+public:
+	LCDEngine(double phi) : Engine("LCD", false), lcd(LCD_Init(phi)) {}
+	~LCDEngine() { LCD_Destroy(lcd); }
+	void Run(const uint32_t* data, const uint32_t*, size_t n) {
+		for (size_t i = 0; i < n; ++i) LCD_Update(lcd, data[i]);
+	}
+	std::map<uint32_t, uint32_t> Output(uint64_t thresh, const ExactCounter&) {
+		return LCD_Output(lcd, thresh);
+	}
+	size_t Size() { return LCD_Size(lcd); }
+	LCD_type* lcd;
+};
+
+class LCLEngine : public Engine {
+public:
+	LCLEngine(double phi) : Engine("LCL", true), lcl(LCL_Init(phi)) {}
+	~LCLEngine() { LCL_Destroy(lcl); }
+	void Run(const uint32_t* data, const uint32_t* values, size_t n) {
+		// uint32_t and int share a representation, and one length fits in
+		// an int; the counts summing them do not past 2^31 bytes
+		LCL_UpdateBatch(lcl, data, (const LCLweight_t*) values, n);
+	}
+	std::map<uint32_t, uint32_t> Output(uint64_t thresh, const ExactCounter&) {
+		return LCL_Output(lcl, thresh);
+	}
+	size_t Size() { return LCL_Size(lcl); }
+	LCL_type* lcl;
+};
+
+class LCUEngine : public Engine {
+public:
+	LCUEngine(double phi) : Engine("LCU", true), lcu(LCU_Init(phi)) {}
+	~LCUEngine() { LCU_Destroy(lcu); }
+	void Run(const uint32_t* data, const uint32_t* values, size_t n) {
+		for (size_t i = 0; i < n; ++i) LCU_Update(lcu, data[i], values[i]);
+	}
+	std::map<uint32_t, uint32_t> Output(uint64_t thresh, const ExactCounter&) {
+		return LCU_Output(lcu, thresh);
+	}
+	size_t Size() { return LCU_Size(lcu); }
+	LCU_type* lcu;
+};
+
+/**
+ * Builds the engines named in a comma separated list, in the order given.
+ * Returns false on an unknown name.
+ */
+bool MakeEngines(std::string algs, double dPhi, double gamma, uint32_t u32Width,
+				 uint32_t u32Depth, uint32_t u32Granularity, std::vector<Engine*>& engines) {
+	if (algs == "all") algs = "ALS,DSpp,DS,CM,CMCU,CMH,CCFC,LC,LCD,LCL,LCU";
+	std::stringstream ss(algs);
+	std::string name;
+	while (std::getline(ss, name, ',')) {
+		if (name == "ALS") engines.push_back(new ALSEngine(dPhi, gamma));
+		else if (name == "DSpp") engines.push_back(new DSppEngine(dPhi, gamma));
+		else if (name == "DS") engines.push_back(new DSEngine(dPhi, gamma));
+		else if (name == "CM") engines.push_back(new CMEngine(u32Width, u32Depth, false));
+		else if (name == "CMCU") engines.push_back(new CMEngine(u32Width, u32Depth, true));
+		else if (name == "CMH") engines.push_back(new CMHEngine(u32Width, u32Depth, u32Granularity));
+		else if (name == "CCFC") engines.push_back(new CCFCEngine(u32Width, u32Depth, u32Granularity));
+		else if (name == "LC") engines.push_back(new LCEngine(dPhi));
+		else if (name == "LCD") engines.push_back(new LCDEngine(dPhi));
+		else if (name == "LCL") engines.push_back(new LCLEngine(dPhi));
+		else if (name == "LCU") engines.push_back(new LCUEngine(dPhi));
+		else {
+			std::cerr << "Unknown algorithm " << name << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * One point of a sweep: the engines built for one phi and gamma, the exact
+ * counts they are checked against and the runs fed to them so far.
+ */
+class Experiment {
+public:
+	Experiment(double phi, double gamma, double skew, int threads, bool counters, bool latency)
+		: phi(phi), gamma(gamma), skew(skew), width(2.0 / phi), exact(threads),
+		  exactPk(threads), total(0), packets(0),
+		  perf(counters ? new PerfCounters() : NULL), latency(latency) {}
+	~Experiment() {
+		for (Engine* e : engines) delete e;
+		delete perf;
+	}
+
+	/**
+	 * Counts one run of n packets exactly, feeds it to every engine (only
+	 * this part is timed) and checks each engine's heavy hitters.
+	 */
+	void Run(const uint32_t* data, const uint32_t* values, size_t n, size_t run) {
+		uint64_t before = total;
+		for (size_t i = 0; i < n; ++i)
+		{
+			assert(values[i] > 0);
+			total += values[i];
+		}
+		if (before < (1ULL << 31) && total >= (1ULL << 31)) {
+			// every engine counting bytes does so in 32 bit counters
+			std::string names;
+			for (Engine* e : engines)
+				if (e->weighted) names += (names.empty() ? "" : ", ") + e->name;
+			if (!names.empty())
+				std::cerr << "Warning: past 2^31 bytes, the 32 bit counters of " << names
+						  << " may wrap" << std::endl;
+		}
+		packets += n;
+		runPackets.push_back(n);
+		// the thresholds are known before counting, so the exact counters
+		// collect the heavy hitters as they go
+		uint64_t thresh = static_cast<uint64_t>(floor(phi * total)+1);
+		uint64_t pkThresh = static_cast<uint64_t>(floor(phi * packets)+1);
+		exact.SetThreshold(thresh);
+		exact.Add(data, values, n);
+		exactPk.SetThreshold(pkThresh);
+		exactPk.Add(data, NULL, n);
+
+		uint64_t t;
+		for (Engine* e : engines) {
+			if (perf) perf->Start();
+			if (latency) {
+				// one call per update, each timed on its own
+				t = 0;
+				for (size_t i = 0; i < n; ++i) {
+					auto start = Clock::now();
+					e->Run(&data[i], &values[i], 1);
+					uint64_t u = StopTheClock(start);
+					e->S.L.Add(u);
+					t += u;
+				}
+			}
+			else {
+				auto start = Clock::now();
+				e->Run(data, values, n);
+				t = StopTheClock(start);
+			}
+			e->S.dU += t;
+			if (perf) perf->Stop(e->S.cU);
+			e->T.push_back(t);
+			if (t > 0) e->S.U.push_back(n * 1e6 / t);
+		}
+
+		if (VERBOSE_EXACT) std::cerr << "total " << total << " thresh " << thresh << std::endl;
+		size_t hh = exact.Heavy(thresh).size();
+		if (VERBOSE_EXACT) std::cerr << "Run: " << run << ", Exact: " << hh << std::endl;
+
+		// packet counting engines are held to the same phi over packets
+		size_t hhPk = exactPk.Heavy(pkThresh).size();
+
+		// Check results against brute force check of heavy hitters.
+		// Only the query itself is timed.
+		for (Engine* e : engines) {
+			const ExactCounter& truth = e->weighted ? exact : exactPk;
+			uint64_t th = e->weighted ? thresh : pkThresh;
+			if (perf) perf->Start();
+			auto start = Clock::now();
+			std::map<uint32_t, uint32_t> res = e->Output(th, truth);
+			e->S.dQ += t = StopTheClock(start);
+			if (perf) perf->Stop(e->S.cQ);
+			e->S.Q.push_back(t / 1e3);
+			CheckOutput(res, th, e->weighted ? hh : hhPk, e->S, truth);
+		}
+	}
+
+	/**
+	 * Prints the table of results, and adds them to the report if there
+	 * is one.  sweep labels the table with the parameters.
+	 */
+	void Print(FILE* table, Report* rep, bool sweep) {
+		if (sweep) fprintf(table, "\nphi %g gamma %g skew %g\n", phi, gamma, skew);
+		fprintf(table, "\nMethod\tUpdates/ms\tSpace\tRecall\t5th\t95th\tPrecis\t5th\t95th\tFreq RE\t5th\t95th\tFP RE\t5th\t95th\tUpd CI\tQuery us\tQuery CI\n");
+		if (rep) {
+			rep->Param("skew", skew);
+			rep->Param("phi", phi);
+			rep->Param("gamma", gamma);
+			rep->Param("width", width);
+			rep->Param("runs", (double) runPackets.size());
+		}
+		for (Engine* e : engines) {
+			PrintOutput(e->name, e->Size(), e->S, packets, table);
+			if (rep) ReportOutput(*rep, e->name, e->Size(), e->S, e->T, runPackets, perf,
+								  latency, e->Swaps(), e->Stalls());
+		}
+		if (perf) {
+			fprintf(table, "\nMethod\tCyc/upd\tIns/upd\tL1D/upd\tLLC/upd\tdTLB/upd\tBrM/upd\tIPC upd"
+				"\tCyc/qry\tIns/qry\tL1D/qry\tLLC/qry\tdTLB/qry\tBrM/qry\tIPC qry\n");
+			for (Engine* e : engines) {
+				PrintCounters(e->name, e->S, packets, e->S.Q.size(), *perf, table);
+			}
+		}
+		if (latency) {
+			fprintf(table, "\nMethod\tp50 ns\tp99\tp99.9\tp99.99\tp99.999\tMax ns\tSwaps\tStalls\n");
+			for (Engine* e : engines) {
+				PrintLatency(e->name, e->S, e->Swaps(), e->Stalls(), table);
+			}
+		}
+		else {
+			for (Engine* e : engines) {
+				if (e->Stalls() > 0)
+					fprintf(stderr, "%s: %lld of %lld table swaps waited for the maintenance\n",
+							e->name.c_str(), (long long) e->Stalls(), (long long) e->Swaps());
+			}
+		}
+		fflush(table);
+	}
+
+	double phi, gamma, skew;
+	uint32_t width;
+	std::vector<Engine*> engines;
+	// ground truth over bytes and over packets, for any 32 bit ids
+	ExactCounter exact, exactPk;
+	uint64_t total, packets;
+	std::vector<size_t> runPackets;
+	// NULL unless counting hardware events.  Opened after the exact
+	// counters' threads and before the engines start theirs, so that it
+	// counts DIM-SUM's maintenance but not the ground truth
+	PerfCounters* perf;
+	bool latency;       // time every update on its own
+};
+
+/**
+ * Pins the calling thread to one core, so that the configurations a sweep
+ * runs side by side neither migrate nor share a core while being timed.
+ */
+void PinThread(unsigned core) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core % std::thread::hardware_concurrency(), &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+/**
+ * Parses a comma separated list of numbers.
+ */
+std::vector<double> ParseList(const char* s) {
+	std::vector<double> list;
+	std::stringstream ss(s);
+	std::string item;
+	while (std::getline(ss, item, ',')) {
+		if (item != "") list.push_back(atof(item.c_str()));
+	}
+	return list;
 }
 
 /******************************************************************/
@@ -227,18 +992,30 @@ int main(int argc, char **argv) {
 	// algorithm and data default parameters
 	size_t stNumberOfPackets = 10000000;
 	size_t stRuns = 20;
-	double dPhi = 0.001; //0.000001; //0.001;
-	double gamma = 1.;
+	std::vector<double> phis(1, 0.001); //0.000001; //0.001;
+	std::vector<double> gammas(1, 1.);
 	bool gammaDefined = false;
 	uint32_t u32Depth = 10;
 	uint32_t u32Granularity = 8;
 	std::string file = "../trace/nyc.dmp";
 	bool timeLaspe = false;
-	double dSkew = 1.0;
+	bool cmSweep = false;
+	bool streaming = false;
+	size_t stChunk = 1 << 22;
+	int key = PCAP_KEY_SRC;
+	std::vector<double> skews(1, 1.0);
+	int jobs = 1;
+	bool counters = false;
+	bool latency = false;
+	std::string algs = "ALS,DSpp,DS,CM,CMCU";
+	int format = REPORT_TABLE;
+	std::string outFile = "";
+	Workload_params workload;
+	Workload_Defaults(&workload);
+	int used;
 
 	// timing
 	uint64_t t;
-	auto start = Clock::now();
 
 	for (int i = 1; i < argc; ++i) {
 		if (strcmp(argv[i], "-np") == 0)
@@ -285,7 +1062,7 @@ int main(int argc, char **argv) {
 				std::cerr << "Missing phi." << std::endl;
 				return -1;
 			}
-			dPhi = atof(argv[i]);
+			phis = ParseList(argv[i]);
 		}
 		else if (strcmp(argv[i], "-f") == 0)
 		{
@@ -299,6 +1076,66 @@ int main(int argc, char **argv) {
 		else if (strcmp(argv[i], "-t") == 0) {
 			timeLaspe = true;
 		}
+		else if (strcmp(argv[i], "-cmsweep") == 0) {
+			cmSweep = true;
+		}
+		else if (strcmp(argv[i], "-key") == 0) {
+			i++;
+			if (i >= argc) {
+				std::cerr << "Missing capture key." << std::endl;
+				return -1;
+			}
+			if (strcmp(argv[i], "src") == 0) key = PCAP_KEY_SRC;
+			else if (strcmp(argv[i], "dst") == 0) key = PCAP_KEY_DST;
+			else if (strcmp(argv[i], "srcport") == 0) key = PCAP_KEY_SRCPORT;
+			else if (strcmp(argv[i], "flow") == 0) key = PCAP_KEY_FLOW;
+			else {
+				usage();
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-stream") == 0) {
+			streaming = true;
+		}
+		else if (strcmp(argv[i], "-chunk") == 0) {
+			i++;
+			if (i >= argc) {
+				std::cerr << "Missing chunk size." << std::endl;
+				return -1;
+			}
+			stChunk = atoi(argv[i]);
+			if (stChunk < 1) stChunk = 1;
+		}
+		else if (strcmp(argv[i], "-algs") == 0) {
+			i++;
+			if (i >= argc) {
+				std::cerr << "Missing algorithm list." << std::endl;
+				return -1;
+			}
+			algs = std::string(argv[i]);
+		}
+		else if (strcmp(argv[i], "-format") == 0) {
+			i++;
+			if (i >= argc) {
+				std::cerr << "Missing output format." << std::endl;
+				return -1;
+			}
+			if (strcmp(argv[i], "table") == 0) format = REPORT_TABLE;
+			else if (strcmp(argv[i], "json") == 0) format = REPORT_JSON;
+			else if (strcmp(argv[i], "csv") == 0) format = REPORT_CSV;
+			else {
+				usage();
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-o") == 0) {
+			i++;
+			if (i >= argc) {
+				std::cerr << "Missing output file name." << std::endl;
+				return -1;
+			}
+			outFile = std::string(argv[i]);
+		}
 		else if (strcmp(argv[i], "-gamma") == 0) {
 			i++;
 			if (i >= argc)
@@ -306,7 +1143,7 @@ int main(int argc, char **argv) {
 				std::cerr << "Missing gamma." << std::endl;
 				return -1;
 			}
-			gamma = atof(argv[i]);
+			gammas = ParseList(argv[i]);
 			gammaDefined = true;
 
 		} else if (strcmp(argv[i], "-z") == 0)
@@ -316,185 +1153,310 @@ int main(int argc, char **argv) {
 				std::cerr << "Missing skew parameter." << std::endl;
 				return -1;
 			}
-			dSkew = atof(argv[i]);
+			skews = ParseList(argv[i]);
+		}
+		else if (strcmp(argv[i], "-perf") == 0) {
+			counters = true;
+		}
+		else if (strcmp(argv[i], "-latency") == 0) {
+			latency = true;
+		}
+		else if (strcmp(argv[i], "-j") == 0) {
+			i++;
+			if (i >= argc) {
+				std::cerr << "Missing number of jobs." << std::endl;
+				return -1;
+			}
+			jobs = atoi(argv[i]);
+			if (jobs < 1) jobs = 1;
+		}
+		else if ((used = Workload_Option(&workload, argc, argv, i)) != 0) {
+			if (used < 0) {
+				usage();
+				return -1;
+			}
+			i += used - 1;
 		}
 		else if (strcmp(argv[i], "-measure_time_granularity") == 0) {
-			uint64_t start_time = 0;
 			auto start = Clock::now();
-			while (start_time == 0) {
-				t = StopTheClock(start);
-			}
-			std::cout << "Time granularity is " << t << " ms" << std::endl;
+			while ((t = StopTheClock(start)) == 0) {}
+			std::cout << "Time granularity is " << t << " ns" << std::endl;
 		} else {
 			usage();
 			return -1;
 		}
 	}
 
-	uint32_t u32Width = 2.0 / dPhi;
-
-	// We fix PRNG to a specific seed for reproducibility.
-	prng_type* prng;
-	prng=prng_Init(44545, 2);
-	int64_t a = (int64_t) (prng_int(prng) % MOD);
-	int64_t b = (int64_t) (prng_int(prng) % MOD);
-	prng_Destroy(prng);
+	if (phis.empty() || gammas.empty() || skews.empty()) {
+		usage();
+		return -1;
+	}
+	// by default, collide in the active hashtable of DIM-SUM; one stream
+	// serves every phi and gamma, so they must agree on its size
+	if (workload.adversary == WORKLOAD_ADV_COLLIDE && workload.advParam == 0) {
+		workload.advParam = DIMSUM::hash_size(phis[0], gammas[0]);
+		for (double phi : phis) {
+			for (double gamma : gammas) {
+				if ((uint64_t) DIMSUM::hash_size(phi, gamma) != workload.advParam) {
+					std::cerr << "-adversary collide needs the size of the hashtable, "
+							  << "collide:size, when the phi and gamma swept give "
+							  << "hashtables of different sizes" << std::endl;
+					return -1;
+				}
+			}
+		}
+	}
 
-	uint32_t u32DomainSize = 1048575;
-	std::vector<uint32_t> exact(u32DomainSize + 1, 0);
-	Stats SLS, SCM ,SCMH, SCCFC, SALS, SLCL, SDIMSUMpp, SDIMSUM;
-	std::vector<uint64_t> TLS, TCM, TCMH, TCCFC, TALS, TLCL, TDIMSUMpp, TDIMSUM;
+	// Results written to standard output keep it to themselves; the table
+	// and progress messages then go to standard error.
+	FILE* reportFile = NULL;
+	if (format != REPORT_TABLE) {
+		reportFile = (outFile == "") ? stdout : fopen(outFile.c_str(), "w");
+		if (reportFile == NULL) {
+			std::cerr << "Unable to write file " << outFile << std::endl;
+			return -1;
+		}
+	}
+	bool quiet = (reportFile == stdout);
+	std::ostream& info = quiet ? std::cerr : std::cout;
 
 	/***************************************************************************
 	 * DATA LOADING - preload all data to remove IO element from algorithm. 
 	 **************************************************************************/
-	std::vector<uint32_t> data;
-	std::vector<uint32_t> values;
-	// Read in trace file
-	size_t stCount = 0;
-	if (file != "") {
-		uint64_t total = 0;
-		std::cout << "Using file: " << file << std::endl;
-		std::ifstream f;
-		f.open(file);
-		if (!f) {
-			std::cout << "Unable to load file" << std::endl;
-			exit(1);
+	// A trace file is mapped, or parsed if it is text; synthetic data is
+	// generated once for each skew into the vectors below.  Either way
+	// data[z] and values[z] point at stNumberOfPackets packets.
+	Trace_type* trace = NULL;
+	Trace_reader* reader = NULL;
+	Workload_type* generator = NULL;
+	uint64_t totalBytes = 0;
+	std::vector<std::vector<uint32_t>> genData;
+	std::vector<std::vector<uint32_t>> genValues;
+	std::vector<const uint32_t*> data;
+	std::vector<const uint32_t*> values;
+	if (streaming) {
+		// only the reader's buffers are held; the trace is read, or
+		// generated, as it runs
+		if (cmSweep) {
+			std::cerr << "Streaming does not work with -cmsweep." << std::endl;
+			return -1;
 		}
-		uint32_t id, length;
-		while (f >> id >> length) {
-			// std::cout << id << " " << length << std::endl;
-			if (length <= 0) continue; // Packets should not be empty!
-			if (total < 0) {
-				std::cerr << "Why is total negative? " << total<<std::endl;
-				break;
-			}
-			if ((total + length) >= 0x7FFFFFFE) {
-				std::cerr <<  "Error! total number of bytes is " << total << " and trying to add " << length << std::endl;
-				break;
+		if (file == "") {
+			info << "Streaming synthetic trace" << std::endl;
+			workload.skew = skews[0];
+			generator = Workload_Init(&workload, stNumberOfPackets);
+		}
+		else {
+			info << "Streaming file: " << file << std::endl;
+			reader = Trace_ReaderInit(file.c_str(), key);
+			if (reader == NULL) {
+				std::cout << "Unable to load file" << std::endl;
+				exit(1);
 			}
-			data.push_back(id);
-			values.push_back(length);
-			total += length;
 		}
-		std::cerr << "Finished loading file. Total number of bytes: " << total << std::endl;
+	}
+	else if (file != "") {
+		info << "Using file: " << file << std::endl;
+		trace = Trace_Open(file.c_str(), key);
+		if (trace == NULL) {
+			std::cout << "Unable to load file" << std::endl;
+			exit(1);
+		}
+		data.push_back(trace->id);
+		values.push_back(trace->len);
+		stNumberOfPackets = trace->count;
+		totalBytes = trace->total;
+		std::cerr << "Finished loading file. Total number of bytes: " << trace->total << std::endl;
 	}
 	else {
-		Tools::Random r = Tools::Random(0xF4A54B);
-		Tools::PRGZipf zipf = Tools::PRGZipf(0, u32DomainSize, dSkew, &r);
-		for (int i = 0; i < stNumberOfPackets; ++i)
-		{
-			++stCount;
-			if (stCount % 500000 == 0)
-				std::cerr << stCount << std::endl;
-			uint32_t v = zipf.nextLong();
-			uint32_t value = hash31(a, b, v) & u32DomainSize;
-			if (value > 0) {
-				data.push_back(value);
-				values.push_back(1);
-			}
-			else {
-				data.push_back(-value);
-				values.push_back(1);
-			}
+		// the lengths do not depend on the skew, so neither does the total
+		genData.resize(skews.size());
+		genValues.resize(skews.size());
+		for (size_t z = 0; z < skews.size(); ++z) {
+			workload.skew = skews[z];
+			Workload_type* w = Workload_Init(&workload, stNumberOfPackets);
+			genData[z].resize(stNumberOfPackets);
+			genValues[z].resize(stNumberOfPackets);
+			Workload_Fill(w, 0, stNumberOfPackets, &genData[z][0], &genValues[z][0]);
+			Workload_Destroy(w);
+			data.push_back(&genData[z][0]);
+			values.push_back(&genValues[z][0]);
 		}
+		for (size_t i = 0; i < stNumberOfPackets; ++i) totalBytes += genValues[0][i];
+	}
+	// the skew only shapes synthetic traces
+	if (file != "") skews.assign(1, NAN);
+
+	if (cmSweep) {
+		const size_t MAX_TRACE_SIZE = 1000000000;
+		RunCMSweep(data[0], values[0], std::min(stNumberOfPackets, MAX_TRACE_SIZE), phis[0],
+				   u32Depth);
+		if (trace) Trace_Destroy(trace);
+		return 0;
 	}
 
 	/***************************************************************************
 	 * ALGORITHM INITIALIZATION
 	 **************************************************************************/
-	ALS_type* als = ALS_Init(dPhi, gamma);
-	DIMSUMpp dimsumpp(dPhi, gamma);
-	DIMSUM dimsum(dPhi, gamma);
-	CM_type* cm = CM_Init(u32Width, u32Depth, 0);
-	
+	// every combination of the swept parameters, skew first
+	struct Config {
+		size_t z;
+		double phi, gamma;
+	};
+	std::vector<Config> configs;
+	for (size_t z = 0; z < skews.size(); ++z) {
+		for (double phi : phis) {
+			for (double gamma : gammas) {
+				Config c = {z, phi, gamma};
+				configs.push_back(c);
+			}
+		}
+	}
+	bool sweep = configs.size() > 1;
+	if (streaming && sweep) {
+		std::cerr << "Streaming runs a single configuration." << std::endl;
+		return -1;
+	}
+	{
+		// check the list before any run starts
+		std::vector<Engine*> probe;
+		bool ok = MakeEngines(algs, phis[0], gammas[0], 2.0 / phis[0], u32Depth,
+							  u32Granularity, probe);
+		for (Engine* e : probe) delete e;
+		if (!ok) {
+			usage();
+			return -1;
+		}
+	}
+	if (counters) {
+		PerfCounters probe;
+		if (!probe.Any()) {
+			std::cerr << "No hardware counters (see /proc/sys/kernel/perf_event_paranoid;"
+					  << " virtual machines often have none), -perf is ignored." << std::endl;
+			counters = false;
+		}
+		for (int e = 0; e < PERF_EVENTS && counters; ++e) {
+			if (!probe.Available(e)) std::cerr << "No counter for " << Perf_names[e] << std::endl;
+		}
+	}
+	// configurations run side by side share the cores with nothing else,
+	// so each counts its ground truth alone
+	int exactThreads = (jobs > 1) ? 1 : std::thread::hardware_concurrency();
+	auto NewExperiment = [&](const Config& c) {
+		Experiment* x = new Experiment(c.phi, c.gamma, skews[c.z], exactThreads, counters, latency);
+		MakeEngines(algs, c.phi, c.gamma, x->width, u32Depth, u32Granularity, x->engines);
+		return x;
+	};
+
 	// Number of runs to complete one pass through our trace. 
 	const size_t MAX_TRACE_SIZE = 1000000000;
-	size_t experimentSize = data.size() > MAX_TRACE_SIZE ? MAX_TRACE_SIZE : data.size();
+	size_t experimentSize = stNumberOfPackets > MAX_TRACE_SIZE ? MAX_TRACE_SIZE : stNumberOfPackets;
 	size_t stRunSize = experimentSize / stRuns;
 	if (VERBOSE_EXACT) {
-		std::cout << "Total Number of Packets in Trace: " << data.size() << std::endl;
+		std::cout << "Total Number of Packets in Trace: " << stNumberOfPackets << std::endl;
 		std::cout << "Number of packets in each run: " << stRunSize << std::endl;
 	}
-	size_t stStreamPos = 0;
-	long long total = 0;
 
-	for (size_t run = 1; run <= stRuns; ++run) {
-
-		bool stop = false;
-		for (size_t i = stStreamPos; i < stStreamPos + stRunSize; ++i)
-		{
-			assert(values[i] > 0);
-			total += abs((int)values[i]);
-			if (total >= 0x7FFFFFFF) {
-				std::cerr << "Error! Total number of bytes is " << total << std::endl;
-				stop = true;
-				break;
-			}
-			exact[data[i]] += values[i];
-			if (exact[data[i]] > 0x7FFFFFFF) {
-				std::cerr << "Strange. Value is too large " <<exact[data[i]]<< " after addding "<<values[i]<< std::endl;
-			}
+	FILE* table = quiet ? stderr : stdout;
+	Report rep(reportFile, format);
+	Report* report = reportFile ? &rep : NULL;
+	if (report) {
+		rep.Param("trace", file == "" ? std::string("synthetic") : file);
+		rep.Param("trace_packets", (double) stNumberOfPackets);
+		rep.Param("trace_bytes", (double) totalBytes);
+		rep.Param("key", std::string(key == PCAP_KEY_DST ? "dst" :
+			key == PCAP_KEY_SRCPORT ? "srcport" : key == PCAP_KEY_FLOW ? "flow" : "src"));
+		rep.Param("stream", streaming ? 1.0 : 0.0);
+		if (file == "") {
+			rep.Param("ids", std::string(workload.ids == WORKLOAD_IDS_UNIFORM ? "uniform" : "zipf"));
+			rep.Param("sizes", std::string(workload.sizes == WORKLOAD_SIZES_LOGNORMAL ? "lognormal" :
+				workload.sizes == WORKLOAD_SIZES_PARETO ? "pareto" : "fixed"));
+			rep.Param("burst_every", (double) workload.burstEvery);
+			rep.Param("drift", workload.drift);
+			rep.Param("adversary", std::string(workload.adversary == WORKLOAD_ADV_DISTINCT ? "distinct" :
+				workload.adversary == WORKLOAD_ADV_COLLIDE ? "collide" :
+				workload.adversary == WORKLOAD_ADV_TIE ? "tie" : "none"));
+			// the hashtable size of collide, or the number of ids of tie
+			rep.Param("adversary_param", (double) workload.advParam);
 		}
-		if (stop) break;
-
-		start = Clock::now();
-		for (size_t i = stStreamPos; i < stStreamPos + stRunSize; ++i) {
-			ALS_Update(als, data[i], values[i]);
+		rep.Param("depth", u32Depth);
+		rep.Param("granularity", u32Granularity);
+	}
 
+	if (streaming) {
+		// every chunk is a run; the next chunk loads while this one runs
+		ChunkStream::Source source;
+		if (reader) {
+			source = [reader](uint32_t* id, uint32_t* len, size_t n) {
+				return Trace_Read(reader, id, len, n);
+			};
 		}
-		SALS.dU += t = StopTheClock(start);
-		TALS.push_back(t);
-
-		start = Clock::now();
-		for (size_t i = stStreamPos; i < stStreamPos + stRunSize; ++i) {
-			dimsumpp.update(data[i], values[i]);
+		else {
+			source = [generator](uint32_t* id, uint32_t* len, size_t n) {
+				return Workload_Read(generator, id, len, n);
+			};
 		}
-		SDIMSUMpp.dU += t = StopTheClock(start);
-		TDIMSUMpp.push_back(t);
-		
-		start = Clock::now();
-		for (size_t i = stStreamPos; i < stStreamPos + stRunSize; ++i) {
-			dimsum.update(data[i], values[i]);
+		ChunkStream stream(source, stChunk);
+		// the reader runs alongside the engines, so it starts first, out of
+		// sight of the counters
+		Experiment* x = NewExperiment(configs[0]);
+		const uint32_t* chunkData;
+		const uint32_t* chunkValues;
+		size_t n;
+		for (size_t run = 1; (n = stream.Next(&chunkData, &chunkValues)) > 0; ++run) {
+			x->Run(chunkData, chunkValues, n, run);
 		}
-		SDIMSUM.dU += t = StopTheClock(start);
-		TDIMSUM.push_back(t);
-
-
-		start = Clock::now();
-		for (size_t i = stStreamPos; i < stStreamPos + stRunSize; ++i) {
-			CM_Update(cm, data[i], values[i]);
+		std::cerr << "Finished streaming. Total number of bytes: " << x->total
+				  << ", waited " << stream.stalled / 1e6 << " ms for the reader" << std::endl;
+		if (report) {
+			rep.Param("trace_packets", (double) x->packets);
+			rep.Param("trace_bytes", (double) x->total);
 		}
-		SCM.dU += t = StopTheClock(start);
-		TCM.push_back(t);
-
-		uint64_t thresh = static_cast<uint64_t>(floor(dPhi * total)+1);//floor(dPhi * run * stRunSize));
-		if (VERBOSE_EXACT) std::cerr << "total " << total << " thresh " << thresh << std::endl;
-		size_t hh = RunExact(thresh, exact);
-		if (VERBOSE_EXACT) std::cerr << "Run: " << run << ", Exact: " << hh << std::endl;
-
-		// Check results against brute force check of heavy hitters.
-		std::map<uint32_t, uint32_t> res;
-		res = ALS_Output(als, thresh);
-		CheckOutput(res, thresh, hh, SALS, exact);
-		res = dimsumpp.output(thresh);
-		CheckOutput(res, thresh, hh, SDIMSUMpp, exact);
-		res = dimsum.output(thresh);
-		CheckOutput(res, thresh, hh, SDIMSUM, exact);
-
-		stStreamPos += stRunSize;
-	} 
-
-	printf("\nMethod\tUpdates/ms\tSpace\tRecall\t5th\t95th\tPrecis\t5th\t95th\tFreq RE\t5th\t95th\n");
-	stNumberOfPackets = data.size();
-	PrintOutput("ALS", ALS_Size(als), SALS, stNumberOfPackets);
-	PrintOutput("DSpp", dimsumpp.size(), SDIMSUMpp, stNumberOfPackets);
-	PrintOutput("DS", dimsum.size(), SDIMSUM, stNumberOfPackets);
-	PrintOutput("CM", CM_Size(cm), SCM, stNumberOfPackets);
-
-	ALS_Destroy(als);
-	CM_Destroy(cm);
+		x->Print(table, report, false);
+		delete x;
+	}
+	else {
+		// Workers take the configurations in turn; each is printed once it
+		// and all before it are done, so the output keeps their order.
+		auto RunConfig = [&](size_t c) {
+			Experiment* x = NewExperiment(configs[c]);
+			size_t stStreamPos = 0;
+			for (size_t run = 1; run <= stRuns; ++run) {
+				x->Run(&data[configs[c].z][stStreamPos], &values[configs[c].z][stStreamPos],
+					   stRunSize, run);
+				stStreamPos += stRunSize;
+			}
+			return x;
+		};
+		std::vector<Experiment*> done(configs.size(), NULL);
+		size_t printed = 0;
+		std::atomic<size_t> next(0);
+		std::mutex lock;
+		auto Worker = [&](int w) {
+			if (jobs > 1) PinThread(w);
+			size_t c;
+			while ((c = next++) < configs.size()) {
+				Experiment* x = RunConfig(c);
+				std::lock_guard<std::mutex> guard(lock);
+				done[c] = x;
+				for (; printed < done.size() && done[printed]; ++printed) {
+					done[printed]->Print(table, report, sweep);
+					delete done[printed];
+				}
+			}
+		};
+		std::vector<std::thread> pool;
+		for (int w = 1; w < jobs && (size_t) w < configs.size(); ++w) {
+			pool.push_back(std::thread(Worker, w));
+		}
+		Worker(0);
+		for (auto& th : pool) th.join();
+	}
+	if (trace) Trace_Destroy(trace);
+	if (reader) Trace_ReaderDestroy(reader);
+	if (generator) Workload_Destroy(generator);
+	if (reportFile && reportFile != stdout) fclose(reportFile);
 
-	std::cout << std::endl;
+	info << std::endl;
 	return 0;
 }
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "lossycount.h"
 #include "prng.h"
 /********************************************************************
@@ -29,6 +30,7 @@ LC_type * LC_Init(float phi)
 	result->window=(int) 1.0/phi;
 	result->maxholder=result->window*4;
 	result->bucket=(LCCounter*) calloc(result->window+2,sizeof(LCCounter));
+	result->scratch=(LCCounter*) calloc(result->window+2,sizeof(LCCounter));
 	result->holder=(LCCounter*) calloc(result->maxholder,sizeof(LCCounter));
 	result->newcount=(LCCounter*) calloc(result->maxholder,sizeof(LCCounter));
 	return(result);
@@ -37,22 +39,74 @@ LC_type * LC_Init(float phi)
 void LC_Destroy(LC_type * lc)
 {
 	free(lc->bucket);
+	free(lc->scratch);
 	free(lc->holder);
 	free(lc->newcount);
 	free(lc);
 }
 
-int lccmp(const void *x, const void *y)
+template <class T>
+static T * lcradixsort(T * a, T * tmp, int n)
 {
-	// used in quicksort to sort lists to get the exact results for comparison
-	const LCCounter * h1= (LCCounter*) x; 
-	const LCCounter * h2= (LCCounter*) y;
-
-	if ((h1->item)<(h2->item)) 
-		return -1; 
-	else if ((h1->item)>(h2->item)) 
-		return 1;
-	else return 0;
+	// LSD radix sort of a bucket of counters on their item, one byte per
+	// pass.  The sign bit is flipped so that the order is the signed order
+	// of the items.  A pass where every item has the same byte is skipped,
+	// so small identifiers only cost one or two passes.
+	// Returns whichever of a and tmp holds the sorted counters.
+
+	int hist[4][256];
+	int i,b,sum,c;
+	unsigned int key;
+	T * swap;
+
+	if (n<2) return a;
+	memset(hist,0,sizeof(hist));
+	for (i=0;i<n;i++)
+	{
+		key=((unsigned int) a[i].item)^0x80000000u;
+		hist[0][key&0xFF]++;
+		hist[1][(key>>8)&0xFF]++;
+		hist[2][(key>>16)&0xFF]++;
+		hist[3][key>>24]++;
+	}
+	for (b=0;b<4;b++)
+	{
+		key=((unsigned int) a[0].item)^0x80000000u;
+		if (hist[b][(key>>(8*b))&0xFF]==n) continue;
+		sum=0;
+		for (i=0;i<256;i++)
+		{
+			c=hist[b][i];
+			hist[b][i]=sum;
+			sum+=c;
+		}
+		for (i=0;i<n;i++)
+		{
+			key=((unsigned int) a[i].item)^0x80000000u;
+			tmp[hist[b][(key>>(8*b))&0xFF]++]=a[i];
+		}
+		swap=a; a=tmp; tmp=swap;
+	}
+	return a;
+}
+
+template <class T>
+static int lcaggregate(T * a, int n)
+{
+	// collapse runs of the same item in a sorted bucket into one counter
+	// each, summing their counts.  Returns the number of counters left.
+	int i,m;
+
+	if (n==0) return 0;
+	m=0;
+	for (i=1;i<n;i++)
+	{
+		if (a[i].item==a[m].item)
+			a[m].count+=a[i].count;
+		else
+			a[++m]=a[i];
+	}
+	return m+1;
 }
 
 void LCShowCounters(LCCounter * counts, int length, int delta)
@@ -68,7 +122,9 @@ void LCShowCounters(LCCounter * counts, int length, int delta)
 int lccountermerge(LCCounter *newcount, LCCounter *left, LCCounter *right,
 				   int l, int r, int maxholder)
 {  // merge up two lists of counters. returns the size of the lists.
-	int i,j,m;
+   // both lists are sorted with at most one counter per item.
+   // every counter loses one, and those that reach zero are dropped
+	int i,j,m,li,ri,takel,taker,count;
 
 	if (l+r>maxholder)
 	{ // a more advanced implementation would do a realloc here...
@@ -80,87 +136,42 @@ int lccountermerge(LCCounter *newcount, LCCounter *left, LCCounter *right,
 	m=0;
 
 	while (i<l && j<r)
-	{ // merge two lists
-		if (left[i].item==right[j].item)
-		{ // sum the counts of identical items
-			newcount[m].item=left[i].item;
-			newcount[m].count=right[j].count;
-			while (left[i].item==right[j].item)
-			{
-				newcount[m].count+=left[i].count;
-				i++;
-			}
-			j++;
-		}
-		else if (left[i].item<right[j].item)
-		{ // else take the left item, creating counts appropriately
-			newcount[m].item=left[i].item;
-			newcount[m].count=0;
-			while (left[i].item==newcount[m].item)
-			{
-				newcount[m].count+=left[i].count;
-				i++;
-			}
-		}
-		else {
-			newcount[m].item=right[j].item;
-			newcount[m].count=right[j].count;
-			j++;
-		}
-		newcount[m].count--;
-		if (newcount[m].count>0) m++;
-		else
-		{ // adjust for items which may have negative or zero counts
-			newcount[m].item=-1;
-			newcount[m].count=0;
-		}
+	{ // merge two lists; the counter is always written, and only kept
+	  // by advancing m, so the compiler can avoid most of the branches
+		li=left[i].item;
+		ri=right[j].item;
+		takel=(li<=ri);
+		taker=(ri<=li);
+		count=(takel ? left[i].count : 0) + (taker ? right[j].count : 0) - 1;
+		newcount[m].item=takel ? li : ri;
+		newcount[m].count=count;
+		m+=(count>0);
+		i+=takel;
+		j+=taker;
 	}
 
 	// now that the main part of the merging has been done
 	// need to copy over what remains of whichever list is not used up
 
-	if (j<r)
+	for (;j<r;j++)
 	{
-		while (j<r)
-		{
-			if (right[j].count > 1)
-			{
-				newcount[m].item=right[j].item;
-				newcount[m].count=right[j].count-1;
-				m++;
-			}
-			j++;
-		}
+		newcount[m].item=right[j].item;
+		newcount[m].count=right[j].count-1;
+		m+=(newcount[m].count>0);
 	}
-	else
-		if (i<l)
-		{
-			while(i<l)
-			{
-				newcount[m].item=left[i].item;
-				newcount[m].count=-1;
-				while ((newcount[m].item==left[i].item) && (i<l))
-				{
-					newcount[m].count+=left[i].count;
-					i++;
-				}
-				if (newcount[m].count>0)
-					m++;
-				else
-				{
-					newcount[m].item=-1;
-					newcount[m].count=0;
-				}
-			}
-		}
-
-		return(m);
+	for (;i<l;i++)
+	{
+		newcount[m].item=left[i].item;
+		newcount[m].count=left[i].count-1;
+		m+=(newcount[m].count>0);
+	}
+	return(m);
 }
 
 
 void LC_Update(LC_type * lc, int val)
 {
-	LCCounter *tmp;
+	LCCounter *tmp, *sorted;
 
 	// interpret a negative item identifier as a removal
 	if (val>0)
@@ -177,9 +188,14 @@ void LC_Update(LC_type * lc, int val)
 	lc->buckets++;
 	if (lc->buckets==lc->window)
 	{
-		qsort(lc->bucket,lc->window,sizeof(LCCounter),lccmp);
+		sorted=lcradixsort(lc->bucket,lc->scratch,lc->window);
+		if (sorted!=lc->bucket)
+		{ // keep bucket pointing at the sorted copy
+			lc->scratch=lc->bucket;
+			lc->bucket=sorted;
+		}
 		lc->holdersize=lccountermerge(lc->newcount,lc->bucket,lc->holder,
-			lc->window,lc->holdersize,lc->maxholder);
+			lcaggregate(lc->bucket,lc->window),lc->holdersize,lc->maxholder);
 		tmp=lc->newcount;
 		lc->newcount=lc->holder;
 		lc->holder=tmp;
@@ -191,21 +207,36 @@ void LC_Update(LC_type * lc, int val)
 int LC_Size(LC_type * lc)
 {
 	int size;
-	size=(lc->maxholder+lc->window)*sizeof(LCCounter)+sizeof(LC_type);
+	size=(lc->maxholder+2*lc->window)*sizeof(LCCounter)+sizeof(LC_type);
 	return size;
 }
 
+template <class T>
+static int lcfind(const T * holder, int n, int item)
+{
+	// the holder comes out of each merge sorted by item, so it is its own
+	// index: binary search for item, returning its position or -1
+	int lo=0, hi=n, mid;
+
+	while (lo<hi)
+	{
+		mid=(lo+hi)>>1;
+		if (holder[mid].item<item) lo=mid+1; else hi=mid;
+	}
+	return (lo<n && holder[lo].item==item) ? lo : -1;
+}
+
 int LC_PointEst(LC_type * lc, int item)
 {
 	int i;
 
-	for (i=0;i<lc->holdersize;i++)
-		if (lc->holder[i].item==item)
-			return(lc->holder[i].count + lc->epoch);
+	i=lcfind(lc->holder,lc->holdersize,item);
+	if (i>=0)
+		return(lc->holder[i].count + lc->epoch);
 	return 0;
 }
 
-std::map<uint32_t, uint32_t> LC_Output(LC_type * lc, int thresh)
+std::map<uint32_t, uint32_t> LC_Output(LC_type * lc, int64_t thresh)
 {
 	std::map<uint32_t, uint32_t> res;
 
@@ -250,6 +281,7 @@ LCD_type * LCD_Init(float phi)
 	result->window=1 + (int) 1.0/phi;
 	result->maxholder=result->window*LCDMULTIPLE;
 	result->bucket=(LCDCounter*) calloc(result->window+2,sizeof(LCDCounter));
+	result->scratch=(LCDCounter*) calloc(result->window+2,sizeof(LCDCounter));
 	result->holder=(LCDCounter*) calloc(result->maxholder,sizeof(LCDCounter));
 	result->newcount=(LCDCounter*) calloc(result->maxholder,sizeof(LCDCounter));
 	return(result);
@@ -258,6 +290,7 @@ LCD_type * LCD_Init(float phi)
 void LCD_Destroy(LCD_type * lc)
 {
 	free(lc->bucket);
+	free(lc->scratch);
 	free(lc->holder);
 	free(lc->newcount);
 	free(lc);
@@ -272,23 +305,12 @@ void LCDShowCounters(LCDCounter * counts, int length)
 		counts[i].item,counts[i].count,counts[i].delta);
 }
 
-int ccmp(const void *x, const void *y)
-{
-	// used in quicksort to sort lists to get the exact results for comparison
-	const LCDCounter * h1= (LCDCounter *) x;
-	const LCDCounter * h2= (LCDCounter *) y;
-
-	if ((h1->item)<(h2->item)) 
-		return -1; 
-	else if ((h1->item)>(h2->item)) 
-		return 1;
-	else return 0;
-}
-
 int lcdcountermerge(LCDCounter *newcount, LCDCounter *left, LCDCounter *right,
 					int l, int r, int maxholder, int epoch)
 {  // merge up two lists of counters. returns the size of the lists.
-	int i,j,m;
+   // both lists are sorted with at most one counter per item.
+   // a counter is kept while its count plus delta exceeds the epoch
+	int i,j,m,li,ri,takel,taker;
 
 	if (l+r>maxholder)
 	{ // a more advanced implementation would do a realloc here...
@@ -302,84 +324,31 @@ int lcdcountermerge(LCDCounter *newcount, LCDCounter *left, LCDCounter *right,
 	// interpretation: left is the new items, right is the existing list
 
 	while (i<l && j<r)
-	{ // merge two lists
-		if (left[i].item==right[j].item)
-		{ // sum the counts of identical items
-			newcount[m].item=left[i].item;
-			newcount[m].count=right[j].count;
-			newcount[m].delta=right[j].delta;
-			while (left[i].item==right[j].item)
-			{ // merge in multiple copies of the same new item
-				newcount[m].count+=left[i].count;
-				++i;
-			}
-			++j;
-		}
-		else if (left[i].item<right[j].item)
-		{ // else take the left item, creating counts appropriately
-			newcount[m].item=left[i].item;
-			newcount[m].count=0;
-			newcount[m].delta=left[i].delta;
-			while (left[i].item==newcount[m].item)
-			{ // merge in multiple new copies of the same item
-				newcount[m].count+=left[i].count;
-				// need to update deltas here? 
-				++i;
-			}
-		}
-		else {
-			newcount[m].item=right[j].item;
-			newcount[m].count=right[j].count;
-			newcount[m].delta=right[j].delta;
-			++j;
-		}
-		if (newcount[m].count+newcount[m].delta > epoch) ++m;
-		else
-		{ // overwrite an item that is not worth keeping
-			newcount[m].item=-1;
-			newcount[m].count=0;
-			newcount[m].delta=0;
-		}
+	{ // merge two lists, an existing item keeps its old delta
+		li=left[i].item;
+		ri=right[j].item;
+		takel=(li<=ri);
+		taker=(ri<=li);
+		newcount[m].item=takel ? li : ri;
+		newcount[m].count=(takel ? left[i].count : 0) + (taker ? right[j].count : 0);
+		newcount[m].delta=taker ? right[j].delta : left[i].delta;
+		m+=(newcount[m].count+newcount[m].delta > epoch);
+		i+=takel;
+		j+=taker;
 	}
 
 	// now that the main part of the merging has been done
 	// need to copy over what remains of whichever list is not used up
 
-	if (j<r)
+	for (;j<r;j++)
 	{
-		while (j<r)
-		{
-			if (right[j].count > 1)
-			{
-				newcount[m].item=right[j].item;
-				newcount[m].count=right[j].count;
-				newcount[m].delta=right[j].delta;
-				if (newcount[m].count+newcount[m].delta > epoch) ++m;
-			}
-			++j;
-		}
+		newcount[m]=right[j];
+		m+=(newcount[m].count+newcount[m].delta > epoch);
 	}
-	else if (i<l)
+	for (;i<l;i++)
 	{
-		while(i<l)
-		{
-			newcount[m].item=left[i].item;
-			newcount[m].delta=left[i].delta;
-			newcount[m].count=0;
-			while ((newcount[m].item==left[i].item) && (i<l))
-			{
-				newcount[m].count+=left[i].count;
-				i++;
-			}
-			if (newcount[m].count+newcount[m].delta > epoch)
-				m++;
-			else
-			{
-				newcount[m].item=-1;
-				newcount[m].count=0;
-				newcount[m].delta=0;
-			}
-		}
+		newcount[m]=left[i];
+		m+=(newcount[m].count+newcount[m].delta > epoch);
 	}
 	return(m);
 }
@@ -387,7 +356,7 @@ int lcdcountermerge(LCDCounter *newcount, LCDCounter *left, LCDCounter *right,
 
 void LCD_Update(LCD_type * lc, int val)
 {
-	LCDCounter *tmp;
+	LCDCounter *tmp, *sorted;
 	// interpret a negative item identifier as a removal
 	if (val>0)
 	{
@@ -408,9 +377,14 @@ void LCD_Update(LCD_type * lc, int val)
 	{
 
 		lc->epoch++;
-		qsort(lc->bucket,lc->window,sizeof(LCDCounter),ccmp);
+		sorted=lcradixsort(lc->bucket,lc->scratch,lc->window);
+		if (sorted!=lc->bucket)
+		{ // keep bucket pointing at the sorted copy
+			lc->scratch=lc->bucket;
+			lc->bucket=sorted;
+		}
 		lc->holdersize=lcdcountermerge(lc->newcount,lc->bucket,lc->holder,
-			lc->window,
+			lcaggregate(lc->bucket,lc->window),
 			lc->holdersize,lc->maxholder,lc->epoch);
 		tmp=lc->newcount;
 		lc->newcount=lc->holder;
@@ -422,7 +396,7 @@ void LCD_Update(LCD_type * lc, int val)
 int LCD_Size(LCD_type * lc)
 {
 	int size;
-	size=(lc->maxholder+lc->window)*sizeof(LCDCounter)+sizeof(LCD_type);
+	size=(lc->maxholder+2*lc->window)*sizeof(LCDCounter)+sizeof(LCD_type);
 	return size;
 }
 
@@ -430,13 +404,13 @@ int LCD_PointEst(LCD_type * lcd, int item)
 {
 	int i;
 
-	for (i=0;i<lcd->holdersize;i++)
-		if (lcd->holder[i].item==item)
-			return(lcd->holder[i].count + lcd->holder[i].delta);
+	i=lcfind(lcd->holder,lcd->holdersize,item);
+	if (i>=0)
+		return(lcd->holder[i].count + lcd->holder[i].delta);
 	return 0;
 }
 
-std::map<uint32_t, uint32_t> LCD_Output(LCD_type * lc, int thresh)
+std::map<uint32_t, uint32_t> LCD_Output(LCD_type * lc, int64_t thresh)
 {
 	std::map<uint32_t, uint32_t> res;
 
@@ -473,278 +447,326 @@ to Creative Commons, 559 Nathan Abbott Way, Stanford, California
 #define LCL_NULLITEM 0x7FFFFFFF
 	// 2^31 -1 as a special character
 
+// The counters form an implicit LCL_ARITY-ary min-heap held as separate
+// arrays, so sifting down only touches the counts of the children, which
+// sit next to each other.  The count array is offset by LCL_HEAPPAD so 
+// that every group of siblings starts on a 16 byte boundary.
+// The hash table is open addressing with linear probing and maps each
+// monitored item to its heap position; slot[] maps back the other way so
+// the table can follow counters as they move in the heap.
+
+#define LCL_ARITY 4
+#define LCL_HEAPPAD (LCL_ARITY-1)
+#define LCL_AHEAD 8 // how far ahead LCL_UpdateBatch hashes and prefetches
+#if defined(__GNUC__) || defined(__clang__)
+#define LCL_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define LCL_PREFETCH(p)
+#endif
+
 LCL_type * LCL_Init(float fPhi)
 {
 	int i;
 	int k = 1 + (int) 1.0/fPhi;
 
 	LCL_type *result = (LCL_type *) calloc(1,sizeof(LCL_type));
-	// needs to be odd so that the heap always has either both children or 
-	// no children present in the data structure
 
-	result->size = (1 + k) | 1; // ensure that size is odd
-	result->hashsize = LCL_HASHMULT*result->size;
-	result->hashtable=(LCLCounter **) calloc(result->hashsize,sizeof(LCLCounter*));
-	result->counters =(LCLCounter*) calloc(1+result->size,sizeof(LCLCounter));
-	// indexed from 1, so add 1
+	result->size = 1 + k;
+	result->hashsize = 1;
+	while (result->hashsize < LCL_HASHMULT*result->size)
+		result->hashsize <<= 1;
+	// a power of two, so the hash is reduced with a mask
+	result->hashtable=(int *) malloc(result->hashsize*sizeof(int));
+	result->heap=(LCLweight_t *) calloc(LCL_HEAPPAD+result->size,sizeof(LCLweight_t));
+	result->count=result->heap+LCL_HEAPPAD;
+	result->item=(LCLitem_t *) malloc(result->size*sizeof(LCLitem_t));
+	result->delta=(LCLweight_t *) calloc(result->size,sizeof(LCLweight_t));
+	result->slot=(int *) malloc(result->size*sizeof(int));
 
 	result->hasha=151261303;
 	result->hashb=6722461; // hard coded constants for the hash table,
 	//should really generate these randomly
-	result->n=(LCLweight_t) 0;
+	result->n=0;
 
-	for (i=1; i<=result->size;i++)
+	for (i=0; i<result->hashsize; i++)
+		result->hashtable[i]=-1;
+	for (i=0; i<result->size;i++)
 	{
-		result->counters[i].next=NULL;
-		result->counters[i].prev=NULL;
-		result->counters[i].item=LCL_NULLITEM;
-		// initialize items and counters to zero
+		result->item[i]=LCL_NULLITEM;
+		result->slot[i]=-1;
+		// initialize items and counters to zero, and not in the table
 	}
-	result->root=&result->counters[1]; // put in a pointer to the top of the heap
 	return(result);
 }
 
 void LCL_Destroy(LCL_type * lcl)
 {
 	free(lcl->hashtable);
-	free(lcl->counters);
+	free(lcl->heap);
+	free(lcl->item);
+	free(lcl->delta);
+	free(lcl->slot);
 	free(lcl);
 }
 
-void LCL_RebuildHash(LCL_type * lcl)
+static inline int LCL_Hash(LCL_type * lcl, LCLitem_t item)
 {
-	// rebuild the hash table and linked list pointers based on current
-	// contents of the counters array
-	int i;
-	LCLCounter * pt;
+	return (int) hash31(lcl->hasha, lcl->hashb, item) & (lcl->hashsize-1);
+}
 
-	for (i=0; i<lcl->hashsize;i++)
-		lcl->hashtable[i]=0;
-	// first, reset the hash table
-	for (i=1; i<=lcl->size;i++) {
-		lcl->counters[i].next=NULL;
-		lcl->counters[i].prev=NULL;
-	}
-	// empty out the linked list
-	for (i=1; i<=lcl->size;i++) { // for each item in the data structure
-		pt=&lcl->counters[i];
-		pt->next=lcl->hashtable[lcl->counters[i].hash];
-		if (pt->next)
-			pt->next->prev=pt;
-		lcl->hashtable[lcl->counters[i].hash]=pt;
+static inline int LCL_Find(LCL_type * lcl, LCLitem_t item, int * hashval)
+{ // return the heap position of item, or -1 if it is not monitored;
+  // hashval is left at its slot or at the empty slot that ends the probe
+	int s=LCL_Hash(lcl,item), pos;
+
+	while ((pos=lcl->hashtable[s])>=0)
+	{
+		if (lcl->item[pos]==item) break;
+		s=(s+1) & (lcl->hashsize-1);
 	}
+	*hashval=s;
+	return pos;
 }
 
-void Heapify(LCL_type * lcl, int ptr)
-{ // restore the heap condition in case it has been violated
-	LCLCounter tmp;
-	LCLCounter * cpt, *minchild;
-	int mc;
+static void LCL_Unhash(LCL_type * lcl, int s)
+{ // remove the entry in slot s, shifting later entries of the probe
+  // sequence back so that no tombstones are needed
+	int mask=lcl->hashsize-1;
+	int i=s, j=s, home;
 
-	while(1)
+	while (1)
 	{
-		if ((ptr<<1) + 1>lcl->size) break;
-		// if the current node has no children
+		j=(j+1) & mask;
+		if (lcl->hashtable[j]<0) break;
+		home=LCL_Hash(lcl,lcl->item[lcl->hashtable[j]]);
+		if ((i<=j) ? (i<home && home<=j) : (i<home || home<=j))
+			continue; // this entry is still reachable from its home
+		lcl->hashtable[i]=lcl->hashtable[j];
+		lcl->slot[lcl->hashtable[i]]=i;
+		i=j;
+	}
+	lcl->hashtable[i]=-1;
+}
 
-		cpt=&lcl->counters[ptr]; // create a current pointer
-		mc=(ptr<<1)+
-			((lcl->counters[ptr<<1].count<lcl->counters[(ptr<<1)+1].count)? 0 : 1);
-		minchild=&lcl->counters[mc];
-		// compute which child is the lesser of the two
+void LCL_RebuildHash(LCL_type * lcl)
+{
+	// rebuild the hash table from the current contents of the heap
+	int i, s;
 
-		if (cpt->count < minchild->count) break;
-		// if the parent is less than the smallest child, we can stop
+	for (i=0; i<lcl->hashsize;i++)
+		lcl->hashtable[i]=-1;
+	for (i=0; i<lcl->size;i++) { // for each item in the data structure
+		if (lcl->slot[i]<0) continue;
+		LCL_Find(lcl,lcl->item[i],&s);
+		lcl->hashtable[s]=i;
+		lcl->slot[i]=s;
+	}
+}
 
-		tmp=*cpt;
-		*cpt=*minchild;
-		*minchild=tmp;
-		// else, swap the parent and child in the heap
+static void LCL_Heapify(LCL_type * lcl, int ptr)
+{ // restore the heap condition below ptr after its count has grown
+  // the counter is held aside while smaller children move up into the hole
+	LCLweight_t * count=lcl->count;
+	LCLweight_t c=count[ptr], d=lcl->delta[ptr];
+	LCLitem_t it=lcl->item[ptr];
+	int s=lcl->slot[ptr];
+	int first, last, mc, i;
 
-		if (cpt->hash==minchild->hash)
-			// test if the hash value of a parent is the same as the 
-			// hash value of its child
-		{ 
-			// swap the prev and next pointers back. 
-			// if the two items are in the same linked list
-			// this avoids some nasty buggy behaviour
-			minchild->prev=cpt->prev;
-			cpt->prev=tmp.prev;
-			minchild->next=cpt->next;
-			cpt->next=tmp.next;
-		} else { // ensure that the pointers in the linked list are correct
-			// check: hashtable has correct pointer (if prev ==0)
-			if (!cpt->prev) { // if there is no previous pointer
-				if (cpt->item!=LCL_NULLITEM)
-					lcl->hashtable[cpt->hash]=cpt; // put in pointer from hashtable
-			} else
-				cpt->prev->next=cpt;
-			if (cpt->next) 
-				cpt->next->prev=cpt; // place in linked list
-
-			if (!minchild->prev) // also fix up the child
-				lcl->hashtable[minchild->hash]=minchild;
-			else
-				minchild->prev->next=minchild; 
-			if (minchild->next)
-				minchild->next->prev=minchild;
-		}
+	while (1)
+	{
+		first=LCL_ARITY*ptr+1;
+		if (first>=lcl->size) break;
+		// if the current node has no children
+		last=first+LCL_ARITY;
+		if (last>lcl->size) last=lcl->size;
+		mc=first;
+		for (i=first+1;i<last;i++)
+			mc=(count[i]<count[mc]) ? i : mc;
+		// compute which child is the least
+		if (c<=count[mc]) break;
+		// if the counter is no bigger than the smallest child, we can stop
+
+		count[ptr]=count[mc];
+		lcl->item[ptr]=lcl->item[mc];
+		lcl->delta[ptr]=lcl->delta[mc];
+		lcl->slot[ptr]=lcl->slot[mc];
+		if (lcl->slot[ptr]>=0) lcl->hashtable[lcl->slot[ptr]]=ptr;
 		ptr=mc;
 		// continue on with the heapify from the child position
-	} 
+	}
+	count[ptr]=c;
+	lcl->item[ptr]=it;
+	lcl->delta[ptr]=d;
+	lcl->slot[ptr]=s;
+	if (s>=0) lcl->hashtable[s]=ptr;
 }
 
-LCLCounter * LCL_FindItem(LCL_type * lcl, LCLitem_t item)
-{ // find a particular item in the date structure and return a pointer to it
-	LCLCounter * hashptr;
-	int hashval;
+static inline int LCL_FindFrom(LCL_type * lcl, LCLitem_t item, int s, int * hashval)
+{ // LCL_Find, starting from a hash value that is already known
+	int pos;
 
-	hashval=(int) hash31(lcl->hasha, lcl->hashb,item) % lcl->hashsize;
-	hashptr=lcl->hashtable[hashval];
-	// compute the hash value of the item, and begin to look for it in 
-	// the hash table
-
-	while (hashptr) {
-		if (hashptr->item==item)
-			break;
-		else hashptr=hashptr->next;
+	while ((pos=lcl->hashtable[s])>=0)
+	{
+		if (lcl->item[pos]==item) break;
+		s=(s+1) & (lcl->hashsize-1);
 	}
-	return hashptr;
-	// returns NULL if we do not find the item
+	*hashval=s;
+	return pos;
 }
 
-void LCL_Update(LCL_type * lcl, LCLitem_t item, LCLweight_t value)
+static void LCL_UpdateHashed(LCL_type * lcl, LCLitem_t item, LCLweight_t value, int home)
 {
-	int hashval;
-	LCLCounter * hashptr;
+	int hashval, pos;
 	// find whether new item is already stored, if so store it and add one
 	// update heap property if necessary
 
 	lcl->n+=value;
-	lcl->counters->item=0; // mark data structure as 'dirty'
-
-	hashval=(int) hash31(lcl->hasha, lcl->hashb,item) % lcl->hashsize;
-	hashptr=lcl->hashtable[hashval];
-	// compute the hash value of the item, and begin to look for it in 
-	// the hash table
-
-	while (hashptr) {
-		if (hashptr->item==item) {
-			hashptr->count+=value; // increment the count of the item
-			Heapify(lcl,hashptr-lcl->counters); // and fix up the heap
-			return;
-		}
-		else hashptr=hashptr->next;
+	lcl->dirty=1; // mark data structure as 'dirty'
+
+	pos=LCL_FindFrom(lcl,item,home,&hashval);
+	if (pos>=0) {
+		lcl->count[pos]+=value; // increment the count of the item
+		LCL_Heapify(lcl,pos); // and fix up the heap
+		return;
 	}
 	// if control reaches here, then we have failed to find the item
 	// so, overwrite smallest heap item and reheapify if necessary
-	// fix up linked list from hashtable
-	if (!lcl->root->prev) // if it is first in its list
-		lcl->hashtable[lcl->root->hash]=lcl->root->next;
-	else
-		lcl->root->prev->next=lcl->root->next;
-	if (lcl->root->next) // if it is not last in the list
-		lcl->root->next->prev=lcl->root->prev;
-	// update the hash table appropriately to remove the old item
-
-	// slot new item into hashtable
-	hashptr=lcl->hashtable[hashval];
-	lcl->root->next=hashptr;
-	if (hashptr)
-		hashptr->prev=lcl->root;
-	lcl->hashtable[hashval]=lcl->root;
+	if (lcl->slot[0]>=0)
+	{ // take the old item out of the hash table; this can shift 
+	  // entries back, so look for the free slot again afterwards
+		LCL_Unhash(lcl,lcl->slot[0]);
+		LCL_Find(lcl,item,&hashval);
+	}
+	lcl->hashtable[hashval]=0;
+	lcl->slot[0]=hashval;
 	// we overwrite the smallest item stored, so we look in the root
-	lcl->root->prev=NULL;
-	lcl->root->item=item;
-	lcl->root->hash=hashval;
-	lcl->root->delta=lcl->root->count;
+	lcl->item[0]=item;
+	lcl->delta[0]=lcl->count[0];
 	// update the implicit lower bound on the items frequency
-	//  value+=lcl->root->delta;
+	lcl->count[0]=value+lcl->delta[0];
 	// update the upper bound on the items frequency
-	lcl->root->count=value+lcl->root->delta;
-	Heapify(lcl,1); // restore heap property if needed
-	// return value;
+	LCL_Heapify(lcl,0); // restore heap property if needed
+}
+
+void LCL_Update(LCL_type * lcl, LCLitem_t item, LCLweight_t value)
+{
+	LCL_UpdateHashed(lcl,item,value,LCL_Hash(lcl,item));
+}
+
+void LCL_UpdateBatch(LCL_type * lcl, const LCLitem_t * items, 
+					 const LCLweight_t * values, int n)
+{ // apply n weighted updates.  Hash values are computed LCL_AHEAD updates
+  // early and their table slots prefetched, and a run of updates to the
+  // same item is applied as one, with a single heap repair.
+	int hashes[LCL_AHEAD];
+	int i, j;
+	LCLweight_t value;
+
+	for (i=0; i<n && i<LCL_AHEAD; i++)
+	{
+		hashes[i]=LCL_Hash(lcl,items[i]);
+		LCL_PREFETCH(&lcl->hashtable[hashes[i]]);
+	}
+	for (i=0; i<n; i=j)
+	{
+		value=values[i];
+		for (j=i+1; j<n && items[j]==items[i]; j++)
+			value+=values[j];
+		LCL_UpdateHashed(lcl,items[i],value,hashes[i%LCL_AHEAD]);
+		for (int k=i+LCL_AHEAD; k<j+LCL_AHEAD && k<n; k++)
+		{
+			hashes[k%LCL_AHEAD]=LCL_Hash(lcl,items[k]);
+			LCL_PREFETCH(&lcl->hashtable[hashes[k%LCL_AHEAD]]);
+		}
+	}
 }
 
 int LCL_Size(LCL_type * lcl)
 { // return the size of the data structure in bytes
 	return sizeof(LCL_type) + (lcl->hashsize * sizeof(int)) + 
-		(lcl->size*sizeof(LCLCounter));
+		(lcl->size*(2*sizeof(LCLweight_t)+sizeof(LCLitem_t)+sizeof(int)));
 }
 
 LCLweight_t LCL_PointEst(LCL_type * lcl, LCLitem_t item)
 { // estimate the count of a particular item
-	LCLCounter * i;
-	i=LCL_FindItem(lcl,item);
-	if (i)
-		return(i->count);
+	int pos, s;
+	pos=LCL_Find(lcl,item,&s);
+	if (pos>=0)
+		return(lcl->count[pos]);
 	else
 		return 0;
 }
 
 LCLweight_t LCL_PointErr(LCL_type * lcl, LCLitem_t item)
 { // estimate the worst case error in the estimate of a particular item
-	LCLCounter * i;
-	i=LCL_FindItem(lcl,item);
-	if (i)
-		return(i->delta);
+	int pos, s;
+	pos=LCL_Find(lcl,item,&s);
+	if (pos>=0)
+		return(lcl->delta[pos]);
 	else
-		return lcl->root->delta;
-}
-
-int LCL_cmp( const void * a, const void * b) {
-	LCLCounter * x = (LCLCounter*) a;
-	LCLCounter * y = (LCLCounter*) b;
-	if (x->count<y->count) return -1;
-	else if (x->count>y->count) return 1;
-	else return 0;
+		return lcl->delta[0];
 }
 
 void LCL_Output(LCL_type * lcl) { // prepare for output
-	if (lcl->counters->item==0) {
-		qsort(&lcl->counters[1],lcl->size,sizeof(LCLCounter),LCL_cmp);
+	// sort the counters by count; a sorted array is still a heap
+	if (lcl->dirty) {
+		std::vector<int> order(lcl->size);
+		std::vector<LCLweight_t> count(lcl->count,lcl->count+lcl->size);
+		std::vector<LCLweight_t> delta(lcl->delta,lcl->delta+lcl->size);
+		std::vector<LCLitem_t> item(lcl->item,lcl->item+lcl->size);
+		std::vector<int> slot(lcl->slot,lcl->slot+lcl->size);
+		for (int i=0;i<lcl->size;i++) order[i]=i;
+		std::stable_sort(order.begin(),order.end(),
+			[&](int x, int y) { return count[x]<count[y]; });
+		for (int i=0;i<lcl->size;i++)
+		{
+			lcl->count[i]=count[order[i]];
+			lcl->delta[i]=delta[order[i]];
+			lcl->item[i]=item[order[i]];
+			lcl->slot[i]=slot[order[i]];
+		}
 		LCL_RebuildHash(lcl);
-		lcl->counters->item=1;
+		lcl->dirty=0;
 	}
 }
 
-std::map<uint32_t, uint32_t> LCL_Output(LCL_type * lcl, int thresh)
+std::map<uint32_t, uint32_t> LCL_Output(LCL_type * lcl, int64_t thresh)
 {
 	std::map<uint32_t, uint32_t> res;
 
-	for (int i=1;i<=lcl->size;++i)
+	for (int i=0;i<lcl->size;++i)
 	{
-		if (lcl->counters[i].count>=thresh)
-			res.insert(std::pair<uint32_t, uint32_t>(lcl->counters[i].item, lcl->counters[i].count));
+		if (lcl->count[i]>=thresh)
+			res.insert(std::pair<uint32_t, uint32_t>(lcl->item[i], lcl->count[i]));
 	}
 
 	return res;
 }
 
 void LCL_CheckHash(LCL_type * lcl, int item, int hash)
-{ // debugging routine to validate the hash table
-	int i;
-	LCLCounter * hashptr, * prev;
+{ // debugging routine to validate the hash table against the heap
+	int i, s;
 
 	for (i=0; i<lcl->hashsize;i++)
 	{
-		prev=NULL;
-		hashptr=lcl->hashtable[i];
-		while (hashptr) {
-			if (hashptr->hash!=i)
-			{
-				printf("\n Hash violation! hash = %d, should be %d \n", 
-					hashptr->hash,i);
-				printf("after inserting item %d with hash %d\n", item, hash);
-			}
-			if (hashptr->prev!=prev)
-			{
-				printf("\n Previous violation! prev = %d, should be %d\n",
-					(int) hashptr->prev, (int) prev);
-				printf("after inserting item %d with hash %d\n",item, hash);
-				exit(EXIT_FAILURE);
-			}
-			prev=hashptr;
-			hashptr=hashptr->next;
+		if (lcl->hashtable[i]<0) continue;
+		if (lcl->slot[lcl->hashtable[i]]!=i)
+		{
+			printf("\n Slot violation! slot = %d, should be %d \n", 
+				lcl->slot[lcl->hashtable[i]],i);
+			printf("after inserting item %d with hash %d\n", item, hash);
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i=0; i<lcl->size;i++)
+	{
+		if (lcl->slot[i]<0) continue;
+		if (LCL_Find(lcl,lcl->item[i],&s)!=i)
+		{
+			printf("\n Item %u at %d cannot be found\n",
+				(unsigned int) lcl->item[i],i);
+			printf("after inserting item %d with hash %d\n",item, hash);
+			exit(EXIT_FAILURE);
 		}
 	}
 }
@@ -752,36 +774,30 @@ void LCL_CheckHash(LCL_type * lcl, int item, int hash)
 void LCL_ShowHash(LCL_type * lcl)
 { // debugging routine to show the hashtable
 	int i;
-	LCLCounter * hashptr;
 
 	for (i=0; i<lcl->hashsize;i++)
 	{
-		printf("%d:",i);
-		hashptr=lcl->hashtable[i];
-		while (hashptr) {
-			printf(" %d [h(%u) = %d, prev = %d] ---> ",(int) hashptr,
-				(unsigned int) hashptr->item,
-				hashptr->hash,
-				(int) hashptr->prev);
-			hashptr=hashptr->next;
-		}
-		printf(" *** \n");
+		if (lcl->hashtable[i]<0) continue;
+		printf("%d: %u [h = %d, pos = %d]\n",i,
+			(unsigned int) lcl->item[lcl->hashtable[i]],
+			LCL_Hash(lcl,lcl->item[lcl->hashtable[i]]),
+			lcl->hashtable[i]);
 	}
 }
 
 
 void LCL_ShowHeap(LCL_type * lcl)
-{ // debugging routine to show the heap
+{ // debugging routine to show the heap, one level per line
 	int i, j;
 
-	j=1;
-	for (i=1; i<=lcl->size; i++)
+	j=0;
+	for (i=0; i<lcl->size; i++)
 	{
-		printf("%d ",(int) lcl->counters[i].count);
+		printf("%d ",(int) lcl->count[i]);
 		if (i==j) 
 		{ 
 			printf("\n");
-			j=2*j+1;
+			j=LCL_ARITY*j+LCL_ARITY;
 		}
 	}
 	printf("\n\n");
@@ -805,6 +821,21 @@ to Creative Commons, 559 Nathan Abbott Way, Stanford, California
 94305, USA. 
 *********************************************************************/
 
+// The stream summary is a set of arrays over k positions kept in order of
+// count.  Positions with the same count form a bucket, an index range 
+// [gfirst, glast] which stores that count once.  An increment moves the 
+// counter to the end of its bucket and then leapfrogs it over each bucket
+// it overtakes, one swap per bucket, so the arrays stay sorted.
+// Items are found through an open addressing table with linear probing,
+// which maps each item to its position; each position records its slot,
+// so a counter can be moved without rehashing.
+// One spare position, k, holds a counter while it is being moved.
+
+static inline int LCU_Hash(LCU_type * lcu, unsigned int item)
+{
+	return (int) hash31(lcu->a,lcu->b,item) & (lcu->tblsz-1);
+}
+
 LCU_type * LCU_Init(float fPhi)
 {
 	int i;
@@ -818,236 +849,216 @@ LCU_type * LCU_Init(float fPhi)
 	result->k=k;
 	result->n=0;  
 
-	result->tblsz=LCU_HASHMULT*k;  
-	result->hashtable=(LCUITEM**) calloc(result->tblsz,sizeof(LCUITEM *));
-	result->groups=(LCUGROUP *)calloc(k,sizeof(LCUGROUP));
-	result->items=(LCUITEM *) calloc(k,sizeof(LCUITEM));
-	result->freegroups=(LCUGROUP **) calloc(k,sizeof(LCUGROUP*));
+	result->tblsz=1;
+	while (result->tblsz<LCU_HASHMULT*k)
+		result->tblsz<<=1;
+	// a power of two, so the hash is reduced with a mask
+	result->hashtable=(int *) malloc(result->tblsz*sizeof(int));
+	result->item=(unsigned int *) calloc(k+1,sizeof(unsigned int));
+	result->delta=(LCUWT *) calloc(k+1,sizeof(LCUWT));
+	result->grp=(int *) calloc(k,sizeof(int));
+	result->slot=(int *) malloc((k+1)*sizeof(int));
+	result->gcount=(LCUWT *) calloc(k+1,sizeof(LCUWT));
+	result->gfirst=(int *) calloc(k+1,sizeof(int));
+	result->glast=(int *) calloc(k+1,sizeof(int));
+	result->freegroups=(int *) calloc(k+1,sizeof(int));
 
 	for (i=0; i<result->tblsz;i++) 
-		result->hashtable[i]=NULL;
-
-	result->root=result->groups;
-	result->groups->count=0;
-	result->groups->nextg=NULL;
-	result->groups->previousg=NULL;
+		result->hashtable[i]=-1;
+	for (i=0; i<=k; i++)
+		result->slot[i]=-1; // no counter holds an item yet
 
-	result->groups->items=result->items;
-	for (i=0; i<k;i++)
-		result->freegroups[i]=&result->groups[i];
+	for (i=0; i<=k; i++)
+		result->freegroups[i]=i;
 	result->gpt=1; // initialize list of free groups
-
-	for (i=0;i<k;i++) 
-	{
-		result->items[i].item=0;
-		result->items[i].delta=0;
-		result->items[i].hash=0;
-		result->items[i].nexti=NULL;
-		result->items[i].previousi=NULL;  // initialize values
-
-		result->items[i].parentg=result->groups;
-		result->items[i].nexting=&(result->items[i+1]);
-		result->items[i].previousing=&(result->items[i-1]); 
-		// create doubly linked list
-	}
-	result->items[0].previousing=&(result->items[k-1]);
-	result->items[k-1].nexting=&(result->items[0]);
-	// fix start and end of linked list
+	// every counter starts in group 0, with a count of zero
+	result->gcount[0]=0;
+	result->gfirst[0]=0;
+	result->glast[0]=k-1;
 
 	return(result);
 }  
 
 void LCU_ShowGroups(LCU_type * lcu) {
-	LCUGROUP *g;
-	LCUITEM *i,*first;
-	int n, wt;
+	int g, i, n, wt;
 
-	g=lcu->groups;
 	wt=0;
 	n=0;
-	while (g!=NULL) 
+	for (i=0; i<lcu->k; i=lcu->glast[g]+1)
 	{
-		printf("Group %d :",g->count);
-		first=g->items;
-		i=first;
-		if (i!=NULL)
-			do 
-			{
-				printf("%d -> ",i->item);
-				i=i->nexting;
-				wt+=g->count;
-				n++;
-			}
-			while (i!=first);
-		else printf(" empty");
-		printf(")");
-		g=g->nextg;
-		if ((g!=NULL) && (g->previousg->nextg!=g))
+		g=lcu->grp[i];
+		printf("Group %d :",lcu->gcount[g]);
+		if (lcu->gfirst[g]!=i)
 			printf("Badly linked");
-		printf("\n");
+		for (int j=lcu->gfirst[g]; j<=lcu->glast[g]; j++)
+		{
+			printf("%d -> ",lcu->item[j]);
+			wt+=lcu->gcount[g];
+			n++;
+		}
+		printf(")\n");
 	}
 	printf("In total, %d items, with a total count of %d\n",n,wt);
 }
 
-void LCU_InsertIntoHashtable(LCU_type *lcu, LCUITEM *newi, int i, int newitem){
-	newi->nexti=lcu->hashtable[i];
-	newi->item=newitem; // overwrite the old item
-	newi->hash=i;
-	newi->previousi=NULL;
-	// insert item into the hashtable
-	if (lcu->hashtable[i])
-		lcu->hashtable[i]->previousi=newi;
-	lcu->hashtable[i]=newi;
+static inline int LCU_Find(LCU_type * lcu, unsigned int item, int * hashval)
+{ // return the position of item, or -1 if it is not monitored;
+  // hashval is left at its slot or at the empty slot that ends the probe
+	int s=LCU_Hash(lcu,item), pos;
+
+	while ((pos=lcu->hashtable[s])>=0)
+	{
+		if (lcu->item[pos]==item) break;
+		s=(s+1) & (lcu->tblsz-1);
+	}
+	*hashval=s;
+	return pos;
 }
 
-int LCU_cmp( const void * a, const void * b) {
-	LCUITEM * x = (LCUITEM*) a;
-	LCUITEM * y = (LCUITEM*) b;
-	if (x->parentg->count<y->parentg->count) return -1;
-	else if (x->parentg->count>y->parentg->count) return 1;
-	else return 0;
+static void LCU_Unhash(LCU_type * lcu, int s)
+{ // remove the entry in slot s, shifting later entries of the probe
+  // sequence back so that no tombstones are needed
+	int mask=lcu->tblsz-1;
+	int i=s, j=s, home;
+
+	while (1)
+	{
+		j=(j+1) & mask;
+		if (lcu->hashtable[j]<0) break;
+		home=LCU_Hash(lcu,lcu->item[lcu->hashtable[j]]);
+		if ((i<=j) ? (i<home && home<=j) : (i<home || home<=j))
+			continue; // this entry is still reachable from its home
+		lcu->hashtable[i]=lcu->hashtable[j];
+		lcu->slot[lcu->hashtable[i]]=i;
+		i=j;
+	}
+	lcu->hashtable[i]=-1;
 }
 
-std::map<uint32_t, uint32_t> LCU_Output(LCU_type * lcu, int thresh)
+std::map<uint32_t, uint32_t> LCU_Output(LCU_type * lcu, int64_t thresh)
 {
 	std::map<uint32_t, uint32_t> res;
 
 	for (int i=0; i<lcu->k; ++i) 
-		if (lcu->items[i].parentg->count>=thresh) 
-			res.insert(std::pair<uint32_t, uint32_t>(lcu->items[i].item, lcu->items[i].parentg->count));
+		if (lcu->gcount[lcu->grp[i]]>=thresh) 
+			res.insert(std::pair<uint32_t, uint32_t>(lcu->item[i], lcu->gcount[lcu->grp[i]]));
 
 	return res;
 }
 
-LCUITEM * LCU_GetNewCounter(LCU_type * lcu) {
-	LCUITEM * newi;
-	int j;
-
-	newi=lcu->root->items;  // take a counter from the first group
-	// but currently it remains in the same group
-
-	newi->nexting->previousing=newi->previousing;
-	newi->previousing->nexting=newi->nexting;
-	// unhook the new item from the linked list in the hash table	    
-
-	// need to remove this item from the hashtable
-	j = newi->hash;
-	if (lcu->hashtable[j]==newi)
-		lcu->hashtable[j]=newi->nexti;
-
-	if (newi->nexti!=NULL)
-		newi->nexti->previousi=newi->previousi;
-	if (newi->previousi!=NULL)
-		newi->previousi->nexti=newi->nexti;
-
-	return (newi);
-}
-
-void LCU_PutInNewGroup(LCU_type * lcu, LCUITEM *newi, LCUGROUP * tmpg){ 
-	LCUGROUP * oldgroup;
-
-	oldgroup=newi->parentg;  
-	// put item in the tmpg group
-	newi->parentg=tmpg;
-
-	if (newi->nexting!=newi) // if the group does not have size 1
-	{ // remove the item from its current group
-		newi->nexting->previousing=newi->previousing;
-		newi->previousing->nexting=newi->nexting;
-		oldgroup->items=oldgroup->items->nexting;
-	}
-	else { // group will be empty
-		if (oldgroup->nextg!=NULL) // there is another group
-			oldgroup->nextg->previousg=oldgroup->previousg;
-		if (lcu->root==oldgroup) // this is the first group
-			lcu->root=oldgroup->nextg;
-		else
-			oldgroup->previousg->nextg=oldgroup->nextg;
-		lcu->freegroups[--lcu->gpt]=oldgroup;
-		// if we have created an empty group, remove it 
-	}	
-	newi->nexting=tmpg->items;
-	newi->previousing=tmpg->items->previousing;
-	newi->previousing->nexting=newi;
-	newi->nexting->previousing=newi;
-}
+static inline void LCU_Move(LCU_type * lcu, int from, int to)
+{ // move the counter at position from into the free position to, and
+  // point its hash table slot at it; its group is left for the caller
+	int s=lcu->slot[from];
 
-void LCU_AddNewGroupAfter(LCU_type * lcu, LCUITEM *newi, LCUGROUP *oldgroup) {
-	LCUGROUP *newgroup;
-
-	// remove item from old group...
-	newi->nexting->previousing=newi->previousing;
-	newi->previousing->nexting=newi->nexting;
-	oldgroup->items=newi->nexting;
-	//get new group
-	newgroup=lcu->freegroups[lcu->gpt++];
-	newgroup->count=oldgroup->count+1; // set count to be one more the prev group
-	newgroup->items=newi;
-	newgroup->previousg=oldgroup;
-	newgroup->nextg=oldgroup->nextg;
-	oldgroup->nextg=newgroup;
-	if (newgroup->nextg!=NULL) // if there is another group
-		newgroup->nextg->previousg=newgroup;
-	newi->parentg=newgroup;
-	newi->nexting=newi;
-	newi->previousing=newi;
+	lcu->item[to]=lcu->item[from];
+	lcu->delta[to]=lcu->delta[from];
+	lcu->slot[to]=s;
+	if (s>=0) lcu->hashtable[s]=to;
 }
 
-void LCU_IncrementCounter(LCU_type * lcu, LCUITEM *newi)
+static void LCU_IncrementCounter(LCU_type * lcu, int p, LCUWT weight)
 {
-	LCUGROUP *oldgroup;
-
-	oldgroup=newi->parentg;
-	if ((oldgroup->nextg!=NULL) && 
-		(oldgroup->nextg->count - oldgroup->count==1))
-		LCU_PutInNewGroup(lcu, newi,oldgroup->nextg);
-	// if the next group exists
-	else { // need to create a new group with a differential of one
-		if (newi->nexting==newi) // if there is only one item in the group...
-			newi->parentg->count++;
-		else      
-			LCU_AddNewGroupAfter(lcu,newi,oldgroup);
+	int g, h, q, r, held;
+	LCUWT count;
+
+	g=lcu->grp[p];
+	count=lcu->gcount[g]+weight;
+	q=lcu->glast[g];
+	if (lcu->gfirst[g]==q && (q+1==lcu->k || lcu->gcount[lcu->grp[q+1]]>count))
+	{ // a group of one which stays below the next group: just count
+		lcu->gcount[g]=count;
+		return;
 	}
-}
-
-void LCU_Update(LCU_type * lcu, int newitem) {
-	int h;
-	LCUITEM *il;
-
-	lcu->n++;
-	h=hash31(lcu->a,lcu->b,newitem) % lcu->tblsz;
-	il=lcu->hashtable[h];
-	while (il) {
-		if (il->item ==newitem) 
-			break;
-		il=il->nexti;
+	// take the counter out of its group: unless it is already last, hold
+	// it aside in the spare position and move the group's last counter
+	// into the hole at p
+	held=(p!=q);
+	if (held)
+	{
+		LCU_Move(lcu,p,lcu->k);
+		LCU_Move(lcu,q,p);
 	}
-	if (il==NULL) // item is not monitored (not in hashtable) 
+	if (lcu->gfirst[g]==q)
+		lcu->freegroups[--lcu->gpt]=g;
+	else
+		lcu->glast[g]=q-1;
+	// leapfrog the hole over every group whose count it now exceeds:
+	// each group shifts down one place by moving its last counter
+	while (q+1<lcu->k)
 	{
-		il=LCU_GetNewCounter(lcu);
-		/// and put it into the hashtable for the new item 
-		il->delta=lcu->root->count;
+		h=lcu->grp[q+1];
+		if (lcu->gcount[h]>=count) break;
+		r=lcu->glast[h];
+		if (!held)
+		{
+			LCU_Move(lcu,q,lcu->k);
+			held=1;
+		}
+		LCU_Move(lcu,r,q);
+		lcu->grp[q]=h;
+		lcu->gfirst[h]=q;
+		lcu->glast[h]=r-1;
+		q=r;
+	}
+	if (q+1<lcu->k && lcu->gcount[lcu->grp[q+1]]==count)
+	{ // join the group with the same count
+		h=lcu->grp[q+1];
+		lcu->gfirst[h]=q;
+	}
+	else
+	{ // need to create a new group for this count
+		h=lcu->freegroups[lcu->gpt++];
+		lcu->gcount[h]=count;
+		lcu->gfirst[h]=q;
+		lcu->glast[h]=q;
+	}
+	lcu->grp[q]=h;
+	if (held) LCU_Move(lcu,lcu->k,q);
+}
+
+void LCU_Update(LCU_type * lcu, int newitem, LCUWT weight) {
+	int h, pos, g, s;
+
+	lcu->n+=weight;
+	pos=LCU_Find(lcu,newitem,&h);
+	if (pos<0) // item is not monitored (not in hashtable) 
+	{ // take the last counter of the first group, which has the least count
+		g=lcu->grp[0];
+		pos=lcu->glast[g];
+		s=lcu->slot[pos];
+		lcu->item[pos]=newitem;
+		lcu->hashtable[h]=pos;
+		lcu->slot[pos]=h;
+		if (s>=0) // remove the old item from the hashtable; if this shifts
+			LCU_Unhash(lcu,s); // the new item back, its slot follows it
+		lcu->delta[pos]=lcu->gcount[g];
 		// initialize delta with count of first group
-		LCU_InsertIntoHashtable(lcu,il,h,newitem);
-		// put the new counter into the first group
-		// counter is already in first group by defn of how we got it
-		LCU_IncrementCounter(lcu, il);
 	}
-	else 
-		LCU_IncrementCounter(lcu, il);
+	LCU_IncrementCounter(lcu,pos,weight);
 	// if we have an item, we need to increment its counter 
 }
 
+void LCU_Update(LCU_type * lcu, int newitem) {
+	LCU_Update(lcu,newitem,1);
+}
+
 int LCU_Size(LCU_type * lcu) {
-	return sizeof(LCU_type)+(lcu->tblsz)*sizeof(LCUITEM*) + 
-		(lcu->k)*(sizeof(LCUITEM) + sizeof(LCUGROUP) + sizeof(LCUITEM*));
+	return sizeof(LCU_type)+(lcu->tblsz)*sizeof(int) + 
+		(lcu->k)*sizeof(int) +
+		(lcu->k+1)*(sizeof(unsigned int) + 2*sizeof(LCUWT) + 4*sizeof(int));
 }
 
 void LCU_Destroy(LCU_type * lcu)
 {
 	free(lcu->freegroups);
-	free(lcu->items);
-	free(lcu->groups);
+	free(lcu->item);
+	free(lcu->delta);
+	free(lcu->grp);
+	free(lcu->slot);
+	free(lcu->gcount);
+	free(lcu->gfirst);
+	free(lcu->glast);
 	free(lcu->hashtable);
 	free (lcu);
-}  
+}
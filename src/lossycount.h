@@ -16,6 +16,7 @@ typedef struct lccounter
 typedef struct LC_type
 {
   LCCounter *bucket;
+  LCCounter *scratch; // second buffer for radix sorting the bucket
   LCCounter *holder;
   LCCounter *newcount;
   int buckets;
@@ -30,7 +31,7 @@ extern void LC_Destroy(LC_type *);
 extern void LC_Update(LC_type *, int);
 extern int LC_Size(LC_type *);
 extern int LC_PointEst(LC_type *, int);
-extern std::map<uint32_t, uint32_t> LC_Output(LC_type *,int);
+extern std::map<uint32_t, uint32_t> LC_Output(LC_type *,int64_t);
 
 // lossycount.h -- header file for Lossy Counting
 // see Manku & Motwani, VLDB 2002 for details
@@ -46,6 +47,7 @@ typedef struct lcdcounter
 typedef struct LCD_type
 {
   LCDCounter *bucket;
+  LCDCounter *scratch; // second buffer for radix sorting the bucket
   LCDCounter *holder;
   LCDCounter *newcount;
   int buckets;
@@ -60,7 +62,7 @@ extern void LCD_Destroy(LCD_type *);
 extern void LCD_Update(LCD_type *, int);
 extern int LCD_Size(LCD_type *);
 extern int LCD_PointEst(LCD_type *, int);
-extern std::map<uint32_t, uint32_t> LCD_Output(LCD_type *,int);
+extern std::map<uint32_t, uint32_t> LCD_Output(LCD_type *,int64_t);
 
 // lclazy.h -- header file for Lazy Lossy Counting
 // see Manku & Motwani, VLDB 2002 for details
@@ -68,118 +70,65 @@ extern std::map<uint32_t, uint32_t> LCD_Output(LCD_type *,int);
 
 /////////////////////////////////////////////////////////
 #define LCLweight_t int
-//#define LCL_SIZE 101 // size of k, for the summary
-// if not defined, then it is dynamically allocated based on user parameter
 ////////////////////////////////////////////////////////
 
 #define LCLitem_t uint32_t
 
-typedef struct lclcounter_t LCLCounter;
-
-struct lclcounter_t
-{
-  LCLitem_t item; // item identifier
-  int hash; // its hash value
-  LCLweight_t count; // (upper bound on) count for the item
-  LCLweight_t delta; // max possible error in count for the value
-  LCLCounter *prev, *next; // pointers in doubly linked list for hashtable
-}; // 32 bytes
-
-#define LCL_HASHMULT 3  // how big to make the hashtable of elements:
-  // multiply 1/eps by this amount
-  // about 3 seems to work well
-
-#ifdef LCL_SIZE
-#define LCL_SPACE (LCL_HASHMULT*LCL_SIZE)
-#endif
+#define LCL_HASHMULT 2  // how big to make the hashtable of elements:
+  // at least this many slots per counter, rounded up to a power of two
 
 typedef struct LCL_type
 {
-  LCLweight_t n;
+  int64_t n; // total weight of the updates
   int hasha, hashb, hashsize;
   int size;
-  LCLCounter *root;
-#ifdef LCL_SIZE
-  LCLCounter counters[LCL_SIZE+1]; // index from 1
-  LCLCounter *hashtable[LCL_SPACE]; // array of pointers to items in 'counters'
-  // 24 + LCL_SIZE*(32 + LCL_HASHMULT*4) + 8
-            // = 24 + 102*(32+12)*4 = 4504
-            // call it 4520 for luck...
-#else
-  LCLCounter *counters;
-  LCLCounter ** hashtable; // array of pointers to items in 'counters'
-#endif
+  int dirty; // updated since the last sort for output
+  LCLweight_t *count; // (upper bound on) count, in heap order
+  LCLitem_t *item; // item identifier at each heap position
+  LCLweight_t *delta; // max possible error in count at each heap position
+  int *slot; // hash table slot of each heap position, -1 if unused
+  int *hashtable; // heap position of each hashed item, -1 if empty
+  LCLweight_t *heap; // allocation that count points into
 } LCL_type;
 
 extern LCL_type * LCL_Init(float fPhi);
 extern void LCL_Destroy(LCL_type *);
 extern void LCL_Update(LCL_type *, LCLitem_t, int);
+extern void LCL_UpdateBatch(LCL_type *, const LCLitem_t *, const LCLweight_t *, int);
 extern int LCL_Size(LCL_type *);
 extern int LCL_PointEst(LCL_type *, LCLitem_t);
 extern int LCL_PointErr(LCL_type *, LCLitem_t);
-extern std::map<uint32_t, uint32_t> LCL_Output(LCL_type *,int);
+extern std::map<uint32_t, uint32_t> LCL_Output(LCL_type *,int64_t);
 
 //////////////////////////////////////////////////////
 typedef int LCUWT;
-//#define LCU_SIZE 101
-// if not defined, then it is dynamically allocated based on user parameter
 //////////////////////////////////////////////////////
 
-#define LCU_HASHMULT 3
-#ifdef LCU_SIZE
-#define LCU_TBLSIZE (LCU_HASHMULT*LCU_SIZE)
-#endif
-
-typedef struct lcu_itemlist LCUITEMLIST;
-typedef struct lcu_group LCUGROUP;
-
-typedef struct lcu_item LCUITEM;
-typedef struct lcu_group LCUGROUP;
-
-struct lcu_group 
-{
-  LCUWT count;
-  LCUITEM *items;
-  LCUGROUP *previousg, *nextg;
-};
-
-struct lcu_item 
-{
-  unsigned int item;
-  int hash;
-  LCUWT delta;
-  LCUGROUP *parentg;
-  LCUITEM *previousi, *nexti;
-  LCUITEM *nexting, *previousing;
-};
+#define LCU_HASHMULT 4 // hash table slots per counter, rounded up to a power of two
 
 typedef struct LCU_type{
 
-  LCUWT n;
-  int gpt;
+  int64_t n; // total weight of the updates
+  int gpt; // number of groups in use
   int k;
-  int tblsz;
+  int tblsz; // a power of two
   long long a,b;
-  LCUGROUP * root;
-#ifdef LCU_SIZE
-  LCUITEM items[LCU_SIZE];
-  LCUGROUP groups[LCU_SIZE];
-  LCUGROUP *freegroups[LCU_SIZE];
-  LCUITEM* hashtable[LCU_TBLSIZE];
-#else
-  LCUITEM * items;
-  LCUGROUP *groups;
-  LCUGROUP **freegroups;
-  LCUITEM **hashtable;
-
-#endif
+  unsigned int * item; // item at each position, in order of count
+  LCUWT * delta; // max possible error at each position
+  int * grp; // group of each position
+  int * slot; // hash table slot of each position, -1 if it holds no item
+  LCUWT * gcount; // count shared by the positions of a group
+  int * gfirst, * glast; // range of positions spanned by a group
+  int * freegroups; // group ids, those from gpt on are free
+  int * hashtable; // position of each hashed item, -1 if empty
 
 } LCU_type;
 
 extern LCU_type * LCU_Init(float fPhi);
 extern void LCU_Destroy(LCU_type *);
 extern void LCU_Update(LCU_type *, int);
+extern void LCU_Update(LCU_type *, int, LCUWT);
 extern int LCU_Size(LCU_type *);
-extern std::map<uint32_t, uint32_t> LCU_Output(LCU_type *,int);
+extern std::map<uint32_t, uint32_t> LCU_Output(LCU_type *,int64_t);
 
 #endif
@@ -44,7 +44,7 @@ LS_type * LS_Init(float fPhi, float gamma)
 	result->hasha = 151261303;
 	result->hashb = 6722461; // hard coded constants for the hash table,
 							 //should really generate these randomly
-	result->n = (LSweight_t)0;
+	result->n = 0;
 
 	result->activeHashtable =
 		(LSCounter **)calloc(result->hashsize, sizeof(LSCounter*));
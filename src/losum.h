@@ -33,7 +33,7 @@ struct LScounter_t
 
 typedef struct LS_type
 {
-	LSweight_t n;
+	int64_t n; // total weight of the updates
 	std::atomic_int blocksLeftThisUpdate, blocksLeft, quantile;
 	int nActive, nPassive, left2Move;
 	int hasha, hashb, hashsize;
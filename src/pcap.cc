@@ -0,0 +1,354 @@
+/********************************************************************
+Packet capture reader for the benchmarks.
+
+Reads classic pcap (microsecond or nanosecond, either byte order) and
+pcapng (section, interface and packet blocks, either byte order) in
+large buffered blocks and parses the link and IP headers in place, so
+a capture can be turned into a trace, or fed to the algorithms, without
+going through tcpdump and text.
+
+Supported link types: Ethernet (with VLAN tags), raw IP, IPv4, IPv6,
+BSD loopback and Linux cooked captures (v1 and v2).
+*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "pcap.h"
+#include "prng.h"
+
+#define PCAP_BUFSIZE (1<<22)
+#define PCAP_MAXCAPLEN (1<<18) // libpcap's largest snap length, 256 KiB
+#define PCAP_MAXBLOCK (1<<20) // a pcapng block: packet, headers and options
+
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_BYTEORDER 0x1A2B3C4D
+#define PCAPNG_IDB 1
+#define PCAPNG_PB 2 // obsolete packet block
+#define PCAPNG_SPB 3
+#define PCAPNG_EPB 6
+
+#define LINK_NULL 0
+#define LINK_ETHERNET 1
+#define LINK_RAW 101
+#define LINK_SLL 113
+#define LINK_IPV4 228
+#define LINK_IPV6 229
+#define LINK_SLL2 276
+
+static inline uint32_t Pcap_Swap32(uint32_t x)
+{
+	return ((x>>24)&0xff) | ((x>>8)&0xff00) | ((x<<8)&0xff0000) | (x<<24);
+}
+
+static inline uint32_t Pcap_U32(Pcap_type * p, const unsigned char * q)
+{ // a 32 bit field of the capture file, in the file's byte order
+	uint32_t x;
+
+	memcpy(&x,q,4);
+	return p->swap ? Pcap_Swap32(x) : x;
+}
+
+static inline uint32_t Pcap_U16(Pcap_type * p, const unsigned char * q)
+{
+	uint16_t x;
+
+	memcpy(&x,q,2);
+	return p->swap ? (uint32_t) ((x>>8) | ((x&0xff)<<8)) : x;
+}
+
+// fields of the packets themselves are in network byte order
+static inline uint32_t Net16(const unsigned char * q)
+{
+	return ((uint32_t) q[0]<<8) | q[1];
+}
+
+static inline uint32_t Net32(const unsigned char * q)
+{
+	return ((uint32_t) q[0]<<24) | ((uint32_t) q[1]<<16) |
+		((uint32_t) q[2]<<8) | q[3];
+}
+
+int Pcap_IsCapture(const void * start, size_t size)
+{ // does a file starting with these bytes hold a capture?
+	uint32_t m;
+
+	if (size<4) return 0;
+	memcpy(&m,start,4);
+	return m==PCAP_MAGIC_US || m==PCAP_MAGIC_NS || m==PCAPNG_SHB ||
+		Pcap_Swap32(m)==PCAP_MAGIC_US || Pcap_Swap32(m)==PCAP_MAGIC_NS;
+}
+
+static int Pcap_Fill(Pcap_type * p, size_t need)
+{ // make sure need bytes from pos on are in the buffer; 0 at end of file
+	size_t got;
+
+	if (p->have-p->pos>=need) return 1;
+	memmove(p->buf,p->buf+p->pos,p->have-p->pos);
+	p->have-=p->pos;
+	p->pos=0;
+	if (need>p->bufsize)
+	{
+		size_t size=p->bufsize;
+		unsigned char * buf;
+
+		while (size<need) size*=2;
+		buf=(unsigned char *) realloc(p->buf,size);
+		if (buf==NULL)
+		{
+			fprintf(stderr,"Out of memory reading the capture\n");
+			return 0;
+		}
+		p->buf=buf;
+		p->bufsize=size;
+	}
+	while (p->have<need)
+	{
+		got=fread(p->buf+p->have,1,p->bufsize-p->have,p->f);
+		if (got==0) return 0;
+		p->have+=got;
+	}
+	return 1;
+}
+
+Pcap_type * Pcap_Init(const char * fname, int key, int bits)
+{ // open a capture; returns NULL if the file is not one
+	Pcap_type * result;
+	uint32_t m;
+
+	result=(Pcap_type *) calloc(1,sizeof(Pcap_type));
+	result->f=fopen(fname,"rb");
+	if (result->f==NULL)
+	{
+		free(result);
+		return NULL;
+	}
+	result->bufsize=PCAP_BUFSIZE;
+	result->buf=(unsigned char *) malloc(result->bufsize);
+	result->key=key;
+	if (bits<1) bits=1;
+	if (bits>31) bits=31; // hash31 gives 31 bits
+	result->mask=(1u<<bits)-1;
+	result->a=(int64_t) 698124007;
+	result->b=(int64_t) 5125833;
+
+	if (!Pcap_Fill(result,4) || !Pcap_IsCapture(result->buf,4))
+	{
+		Pcap_Destroy(result);
+		return NULL;
+	}
+	memcpy(&m,result->buf,4);
+	if (m==PCAPNG_SHB)
+		result->ng=1; // the section header is handled as a block
+	else
+	{
+		result->swap=(m!=PCAP_MAGIC_US && m!=PCAP_MAGIC_NS);
+		if (!Pcap_Fill(result,24))
+		{
+			Pcap_Destroy(result);
+			return NULL;
+		}
+		result->linktype=Pcap_U32(result,result->buf+20) & 0xffff;
+		result->pos=24;
+	}
+	return result;
+}
+
+static int Pcap_Packet(Pcap_type * p, int link, const unsigned char * d,
+					   uint32_t caplen, uint32_t * id, uint32_t * len)
+{ // find the IP header behind the link header and make the pair for it;
+  // returns 0 if the packet is skipped
+	uint32_t type, off, hl, proto, src, dst, ports;
+	uint32_t fam;
+	long h;
+
+	switch (link)
+	{
+	case LINK_ETHERNET:
+		if (caplen<14) return 0;
+		off=14;
+		type=Net16(d+12);
+		while ((type==0x8100 || type==0x88a8) && caplen>=off+4)
+		{ // VLAN tags
+			type=Net16(d+off+2);
+			off+=4;
+		}
+		break;
+	case LINK_RAW: case LINK_IPV4: case LINK_IPV6:
+		if (caplen<1) return 0;
+		off=0;
+		type=(d[0]>>4)==6 ? 0x86DD : 0x0800;
+		break;
+	case LINK_SLL:
+		if (caplen<16) return 0;
+		off=16;
+		type=Net16(d+14);
+		break;
+	case LINK_SLL2:
+		if (caplen<20) return 0;
+		off=20;
+		type=Net16(d);
+		break;
+	case LINK_NULL:
+		if (caplen<4) return 0;
+		off=4;
+		memcpy(&fam,d,4);
+		if (p->swap) fam=Pcap_Swap32(fam);
+		type=(fam==2) ? 0x0800 :
+			(fam==24 || fam==28 || fam==30) ? 0x86DD : 0;
+		break;
+	default:
+		return 0;
+	}
+
+	d+=off;
+	caplen-=off;
+	ports=0;
+	if (type==0x0800)
+	{
+		if (caplen<20 || (d[0]>>4)!=4) return 0;
+		hl=(d[0]&0x0f)*4;
+		*len=Net16(d+2);
+		proto=d[9];
+		src=Net32(d+12);
+		dst=Net32(d+16);
+		// ports are only in the first fragment
+		if ((proto==6 || proto==17) && (Net16(d+6)&0x1fff)==0 && caplen>=hl+4)
+			ports=Net32(d+hl);
+	}
+	else if (type==0x86DD)
+	{
+		if (caplen<40 || (d[0]>>4)!=6) return 0;
+		*len=Net16(d+4)+40;
+		proto=d[6];
+		// fold each 128 bit address into 32 bits
+		src=Net32(d+8)^Net32(d+12)^Net32(d+16)^Net32(d+20);
+		dst=Net32(d+24)^Net32(d+28)^Net32(d+32)^Net32(d+36);
+		if ((proto==6 || proto==17) && caplen>=44)
+			ports=Net32(d+40);
+	}
+	else
+		return 0;
+	if (*len==0) return 0; // packets should not be empty
+
+	switch (p->key)
+	{
+	case PCAP_KEY_DST:
+		h=hash31(p->a,p->b,dst);
+		break;
+	case PCAP_KEY_SRCPORT:
+		h=hash31(p->a,p->b,hash31(p->a,p->b,src)^(ports>>16));
+		break;
+	case PCAP_KEY_FLOW:
+		h=hash31(p->a,p->b,src);
+		h=hash31(p->a,p->b,h^dst);
+		h=hash31(p->a,p->b,h^ports);
+		h=hash31(p->a,p->b,h^proto);
+		break;
+	default:
+		h=hash31(p->a,p->b,src);
+	}
+	*id=(uint32_t) h & p->mask;
+	return 1;
+}
+
+size_t Pcap_Read(Pcap_type * p, uint32_t * id, uint32_t * len, size_t max)
+{ // read up to max IP packets into id and len; returns 0 at the end
+	const unsigned char * b;
+	uint32_t type, total, caplen, ifid, m;
+	size_t n=0;
+
+	while (n<max)
+	{
+		if (!p->ng)
+		{ // record header: seconds, fraction, captured and original length
+			if (!Pcap_Fill(p,16)) break;
+			caplen=Pcap_U32(p,p->buf+p->pos+8);
+			if (caplen>PCAP_MAXCAPLEN)
+			{
+				fprintf(stderr,"Corrupt pcap record\n");
+				break;
+			}
+			if (!Pcap_Fill(p,16+(size_t) caplen)) break;
+			b=p->buf+p->pos;
+			p->pos+=16+(size_t) caplen;
+			p->packets++;
+			if (Pcap_Packet(p,p->linktype,b+16,caplen,id+n,len+n)) n++;
+			else p->skipped++;
+			continue;
+		}
+
+		// pcapng block: type, total length, body, total length again
+		if (!Pcap_Fill(p,12)) break;
+		b=p->buf+p->pos;
+		memcpy(&type,b,4);
+		if (type==PCAPNG_SHB)
+		{ // a new section sets the byte order and forgets the interfaces
+			memcpy(&m,b+8,4);
+			if (m!=PCAPNG_BYTEORDER && Pcap_Swap32(m)!=PCAPNG_BYTEORDER)
+			{
+				fprintf(stderr,"Corrupt pcapng section header\n");
+				break;
+			}
+			p->swap=(m!=PCAPNG_BYTEORDER);
+			p->nif=0;
+		}
+		type=Pcap_U32(p,b);
+		total=Pcap_U32(p,b+4);
+		if (total<12 || total%4 || total>PCAP_MAXBLOCK)
+		{
+			fprintf(stderr,"Corrupt pcapng block\n");
+			break;
+		}
+		if (!Pcap_Fill(p,total)) break;
+		b=p->buf+p->pos;
+		p->pos+=total;
+
+		if (type==PCAPNG_IDB && total>=20)
+		{
+			if (p->nif==p->ifcap)
+			{
+				p->ifcap=p->ifcap ? 2*p->ifcap : 4;
+				p->iflink=(int *) realloc(p->iflink,p->ifcap*sizeof(int));
+			}
+			p->iflink[p->nif++]=Pcap_U16(p,b+8);
+			continue;
+		}
+		if (type==PCAPNG_EPB && total>=32)
+		{
+			ifid=Pcap_U32(p,b+8);
+			caplen=Pcap_U32(p,b+20);
+		}
+		else if (type==PCAPNG_PB && total>=32)
+		{
+			ifid=Pcap_U16(p,b+8);
+			caplen=Pcap_U32(p,b+20);
+		}
+		else if (type==PCAPNG_SPB && total>=16)
+		{ // the simple block has no captured length of its own
+			ifid=0;
+			caplen=Pcap_U32(p,b+8);
+			if (caplen>total-16) caplen=total-16;
+		}
+		else
+			continue; // statistics, name resolution and other blocks
+		p->packets++;
+		if (ifid>=(uint32_t) p->nif ||
+			caplen>total-(type==PCAPNG_SPB ? 16 : 32) ||
+			!Pcap_Packet(p,p->iflink[ifid],b+(type==PCAPNG_SPB ? 12 : 28),
+						 caplen,id+n,len+n))
+			p->skipped++;
+		else
+			n++;
+	}
+	return n;
+}
+
+void Pcap_Destroy(Pcap_type * p)
+{
+	if (p->f) fclose(p->f);
+	free(p->buf);
+	free(p->iflink);
+	free(p);
+}
@@ -0,0 +1,44 @@
+// pcap.h -- reads packet captures in pcap or pcapng form, without libpcap,
+// and turns every IPv4 or IPv6 packet into an (id, length) pair.
+//
+// The id is a key taken from the IP header, hashed into a domain of
+// 2^bits items; the length is the IP total length.  Packets that are not
+// IP, or whose headers were cut short by the snap length, are skipped.
+// Reading stops, as at a corrupt file, at a record that claims more than
+// 256 KiB of packet or a pcapng block over 1 MiB.
+
+#ifndef PCAP_h
+#define PCAP_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define PCAP_KEY_SRC 0     // source address
+#define PCAP_KEY_DST 1     // destination address
+#define PCAP_KEY_SRCPORT 2 // source address and port
+#define PCAP_KEY_FLOW 3    // 5-tuple: addresses, ports and protocol
+
+#define PCAP_DOMAINBITS 20 // the item domain of hh and wfu
+
+typedef struct Pcap_type{
+  FILE * f;
+  unsigned char * buf;
+  size_t bufsize, have, pos;
+  int ng; // pcapng rather than classic pcap
+  int swap; // file byte order differs from ours
+  int linktype; // link type of a classic pcap
+  int * iflink; // link type of each pcapng interface
+  int nif, ifcap;
+  int key;
+  uint32_t mask;
+  int64_t a, b;
+  uint64_t packets, skipped;
+} Pcap_type;
+
+extern int Pcap_IsCapture(const void *, size_t);
+extern Pcap_type * Pcap_Init(const char *, int, int);
+extern size_t Pcap_Read(Pcap_type *, uint32_t *, uint32_t *, size_t);
+extern void Pcap_Destroy(Pcap_type *);
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Hardware performance counters, see perfcount.h.
+ */
+#include "perfcount.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+const char* Perf_names[PERF_EVENTS] = {
+	"cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses"
+};
+
+#ifdef __linux__
+static int PerfOpen(uint32_t type, uint64_t config) {
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	// also the threads this one starts from now on, such as DIM-SUM's
+	// maintenance thread
+	attr.inherit = 1;
+	// this thread, on any cpu
+	return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t PerfCache(uint64_t cache, uint64_t op, uint64_t result) {
+	return cache | (op << 8) | (result << 16);
+}
+#endif
+
+PerfCounters::PerfCounters() {
+	memset(start, 0, sizeof(start));
+	memset(started, 0, sizeof(started));
+	for (int e = 0; e < PERF_EVENTS; ++e) fd[e] = -1;
+#ifdef __linux__
+	fd[PERF_CYCLES] = PerfOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	fd[PERF_INSTRUCTIONS] = PerfOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	fd[PERF_L1DMISSES] = PerfOpen(PERF_TYPE_HW_CACHE, PerfCache(PERF_COUNT_HW_CACHE_L1D,
+		PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+	fd[PERF_LLCMISSES] = PerfOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	fd[PERF_DTLBMISSES] = PerfOpen(PERF_TYPE_HW_CACHE, PerfCache(PERF_COUNT_HW_CACHE_DTLB,
+		PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+	fd[PERF_BRANCHMISSES] = PerfOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+	for (int e = 0; e < PERF_EVENTS; ++e) {
+		if (fd[e] >= 0) close(fd[e]);
+	}
+}
+
+bool PerfCounters::Any() const {
+	for (int e = 0; e < PERF_EVENTS; ++e) {
+		if (Available(e)) return true;
+	}
+	return false;
+}
+
+bool PerfCounters::Read(int event, uint64_t* v) {
+	return read(fd[event], v, 3 * sizeof(uint64_t)) == (ssize_t) (3 * sizeof(uint64_t));
+}
+
+void PerfCounters::Start() {
+	// the counters run all along; a pass is the difference of two reads,
+	// which saves resetting and enabling them around every pass; an event
+	// whose read fails sits this pass out
+	for (int e = 0; e < PERF_EVENTS; ++e) {
+		started[e] = Available(e) && Read(e, start[e]);
+	}
+}
+
+void PerfCounters::Stop(double* sum) {
+	uint64_t v[3];
+
+	for (int e = 0; e < PERF_EVENTS; ++e) {
+		if (!started[e] || !Read(e, v)) continue;
+		double count = (double) (v[0] - start[e][0]);
+		uint64_t enabled = v[1] - start[e][1];
+		uint64_t running = v[2] - start[e][2];
+		// scale up a count that only ran part of the time
+		if (running > 0 && running < enabled) count *= (double) enabled / running;
+		sum[e] += count;
+	}
+}
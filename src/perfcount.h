@@ -0,0 +1,60 @@
+// perfcount.h -- hardware performance counters around a piece of code,
+// through Linux perf_event_open.
+//
+// The counters follow the thread that opened them and the threads it
+// starts afterwards, in user space only, so they need no privileges beyond
+// perf_event_paranoid <= 2.  Threads started before the counters are left
+// out, and work a background thread does during a pass is counted in that
+// pass, whichever code it belongs to.  Each event is
+// opened on its own, so those the machine or the kernel refuses are left
+// out and the rest still count; when the PMU has fewer counters than
+// events, the kernel multiplexes them and the counts are scaled up by the
+// share of the time each one was running.  Elsewhere than on Linux no
+// event is available.
+
+#ifndef PERFCOUNT_h
+#define PERFCOUNT_h
+
+#include <stdint.h>
+
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_L1DMISSES 2    // L1 data cache read misses
+#define PERF_LLCMISSES 3    // last level cache misses
+#define PERF_DTLBMISSES 4   // data TLB read misses
+#define PERF_BRANCHMISSES 5
+#define PERF_EVENTS 6
+
+extern const char* Perf_names[PERF_EVENTS];
+
+class PerfCounters {
+public:
+	/**
+	 * Opens the counters for the calling thread.  They count that thread
+	 * and those it starts from then on; Start() and Stop() read them, and
+	 * a pass is measured as the difference of the two reads.
+	 */
+	PerfCounters();
+	~PerfCounters();
+
+	bool Available(int event) const { return fd[event] >= 0; }
+	bool Any() const;
+
+	void Start();
+
+	/**
+	 * Adds the events counted since Start() to sum, leaving alone the
+	 * entries of events that are unavailable or could not be read at
+	 * either end of the pass.
+	 */
+	void Stop(double* sum);
+
+private:
+	bool Read(int event, uint64_t* v);
+
+	int fd[PERF_EVENTS];
+	uint64_t start[PERF_EVENTS][3]; // value, time enabled, time running
+	bool started[PERF_EVENTS]; // whether start holds a read of this pass
+};
+
+#endif
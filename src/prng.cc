@@ -97,6 +97,26 @@ int MedSelect(int k, int n, int arr[]) {
 }
 
 
+int MedNetwork(int k, int n, int arr[]) {
+
+  // Same contract as MedSelect: returns the k-th smallest of arr[1..n].
+  // Small arrays are sorted with a fixed network of compare-exchanges,
+  // which has no data dependent branches and needs no extra space.
+
+  int i, j, a, b;
+
+  if (n > MEDNET_MAX) return MedSelect(k, n, arr);
+  for (i=2; i<=n; i++)
+    for (j=i; j>1; j--) {
+      a=arr[j-1];
+      b=arr[j];
+      arr[j-1]=(a < b) ? a : b;
+      arr[j]=(a < b) ? b : a;
+    }
+  return arr[k];
+}
+
+
 long hash31(int64_t a, int64_t b, int64_t x)
 {
 
@@ -616,6 +636,9 @@ Tools::Random::Random(uint32_t seed, RandomGeneratorType t)
 	case RGT_DRAND48:
 		initDrand(0x330E);
 		break;
+	case RGT_XOSHIRO256:
+		initXoshiro();
+		break;
 	}
 }
 
@@ -634,6 +657,9 @@ Tools::Random::~Random()
 		break;
 	case RGT_DRAND48:
 		break;
+	case RGT_XOSHIRO256:
+		delete[] reinterpret_cast<uint64_t*>(m_buffer);
+		break;
 	}
 }
 
@@ -667,9 +693,99 @@ void Tools::Random::initDrand(uint16_t xsubi0)
 		// of the size of unsigned long and unsigned short.
 }
 
+void Tools::Random::initXoshiro()
+{
+	uint64_t* s = new uint64_t[4];
+	uint64_t z = m_seed;
+
+	// splitmix64 spreads the seed over the state, so that close seeds give
+	// unrelated streams and no seed gives the all zero state
+	for (int i = 0; i < 4; i++)
+	{
+		z += 0x9E3779B97F4A7C15ULL;
+		uint64_t x = z;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		s[i] = x ^ (x >> 31);
+	}
+	m_buffer = s;
+}
+
+static inline uint64_t rotl64(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+// one step of xoshiro256** on the state s0..s3, returning the output
+#define XOSHIRO_STEP(s0, s1, s2, s3, r) \
+	{ \
+		r = rotl64(s1 * 5, 7) * 9; \
+		uint64_t t = s1 << 17; \
+		s2 ^= s0; \
+		s3 ^= s1; \
+		s1 ^= s2; \
+		s0 ^= s3; \
+		s2 ^= t; \
+		s3 = rotl64(s3, 45); \
+	}
+
+inline uint64_t Tools::Random::nextXoshiro()
+{
+	uint64_t* s = reinterpret_cast<uint64_t*>(m_buffer);
+	uint64_t r;
+	XOSHIRO_STEP(s[0], s[1], s[2], s[3], r);
+	return r;
+}
+
+void Tools::Random::fill(uint64_t* out, size_t n)
+{
+	if (m_type == RGT_XOSHIRO256)
+	{
+		// the state is kept in registers for the whole batch
+		uint64_t* s = reinterpret_cast<uint64_t*>(m_buffer);
+		uint64_t s0 = s[0], s1 = s[1], s2 = s[2], s3 = s[3];
+		for (size_t i = 0; i < n; i++)
+		{
+			XOSHIRO_STEP(s0, s1, s2, s3, out[i]);
+		}
+		s[0] = s0; s[1] = s1; s[2] = s2; s[3] = s3;
+	}
+	else
+	{
+		for (size_t i = 0; i < n; i++) out[i] = nextUniformUnsignedLongLong();
+	}
+}
+
+void Tools::Random::fillDouble(double* out, size_t n)
+{
+	if (m_type == RGT_XOSHIRO256)
+	{
+		// the top 53 bits make the mantissa; the words are drawn into a
+		// block of their own, and converted in a separate loop, which the
+		// compiler vectorises
+		uint64_t block[256];
+		for (size_t i = 0; i < n; i += 256)
+		{
+			size_t m = std::min<size_t>(256, n - i);
+			fill(block, m);
+			for (size_t j = 0; j < m; j++)
+				out[i + j] = (block[j] >> 11) * (1.0 / 9007199254740992.0);
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < n; i++) out[i] = nextUniformDouble();
+	}
+}
+
 int32_t Tools::Random::nextUniformLong()
 {
-	if (m_type == RGT_DRAND48)
+	if (m_type == RGT_XOSHIRO256)
+	{
+		return static_cast<int32_t>(nextXoshiro() >> 32);
+			// the high bits are the best of xoshiro256**, as of any.
+	}
+	else if (m_type == RGT_DRAND48)
 	{
 		return jrand48(m_xsubi);
 			// Careful: jrand48 modifies m_xsubi after the call.
@@ -748,6 +864,7 @@ int64_t Tools::Random::nextUniformLongLong()
 
 uint64_t Tools::Random::nextUniformUnsignedLongLong()
 {
+	if (m_type == RGT_XOSHIRO256) return nextXoshiro();
 	uint64_t high = static_cast<uint64_t>(nextUniformUnsignedLong());
 	uint64_t low = static_cast<uint64_t>(nextUniformUnsignedLong());
 	return (high << 32) | low;
@@ -776,7 +893,11 @@ uint16_t Tools::Random::nextUniformUnsignedShort()
 
 double Tools::Random::nextUniformDouble()
 {
-	if (m_type == RGT_DRAND48)
+	if (m_type == RGT_XOSHIRO256)
+	{
+		return (nextXoshiro() >> 11) * (1.0 / 9007199254740992.0);
+	}
+	else if (m_type == RGT_DRAND48)
 	{
 		return erand48(m_xsubi);
 			// Careful: erand48 modifies m_xsubi after the call.
@@ -929,6 +1050,10 @@ bool Tools::Random::flipCoin()
 		if ((nextUniformLong() & 1) == 1) return true;
 		return false;
 	}
+	else if (m_type == RGT_XOSHIRO256)
+	{
+		return (nextXoshiro() >> 63) == 1;
+	}
 	else
 	{
 		throw Tools::NotSupportedException(
@@ -956,48 +1081,94 @@ uint32_t Tools::Random::getSeed() const
 	return m_seed;
 }
 
+// log1p(x) / x, accurate near 0
+static double helper1(double x)
+{
+	if (std::fabs(x) > 1e-8) return std::log1p(x) / x;
+	return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+// expm1(x) / x, accurate near 0
+static double helper2(double x)
+{
+	if (std::fabs(x) > 1e-8) return std::expm1(x) / x;
+	return 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+}
+
 Tools::PRGZipf::PRGZipf(int32_t min, int32_t max, double s, Tools::Random* pRandom)
  : m_min(min), m_max(max), m_s(s), m_pRandom(pRandom)
 {
-	initLookupTable();
+	assert(s >= 0.0);
+
+	// the ranks of the former lookup table: min itself is never drawn
+	m_n = std::max(m_max - m_min - 1, 1);
+	m_hIntegralX1 = hIntegral(1.5) - 1.0;
+	m_hIntegralN = hIntegral(m_n + 0.5);
+	m_squeeze = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
 }
 
 Tools::PRGZipf::~PRGZipf()
 {
-	delete[] m_pLookupTable;
 }
 
-void Tools::PRGZipf::initLookupTable()
+// h(x) = x^-s, the density that the ranks are drawn under
+double Tools::PRGZipf::h(double x) const
 {
-	uint32_t N = m_max - m_min;
-	double Hns = 0.0;
+	return std::exp(-m_s * std::log(x));
+}
 
-	for (uint32_t k = 1; k < N; k++)
-		Hns += 1.0 / std::pow(static_cast<double>(k), m_s);
+// an antiderivative of h: (x^(1-s) - 1) / (1 - s), or log(x) when s = 1
+double Tools::PRGZipf::hIntegral(double x) const
+{
+	double logX = std::log(x);
+	return helper2((1.0 - m_s) * logX) * logX;
+}
 
-	m_pLookupTable = new double[N];
+double Tools::PRGZipf::hIntegralInverse(double x) const
+{
+	double t = x * (1.0 - m_s);
+	if (t < -1.0) t = -1.0; // rounding near the upper end of the range
+	return std::exp(helper1(t) * x);
+}
 
-	double sum = 0.0;
-	m_pLookupTable[0] = sum;
-	for (uint32_t k = 1; k < N; k++)
+int32_t Tools::PRGZipf::nextLong()
+{
+	// invert a uniform point under the continuous hull of the histogram,
+	// and keep the rank it falls on unless it is in the hull's overhang
+	for (;;)
 	{
-		sum += 1.0 / std::pow(static_cast<double>(k), m_s);
-		m_pLookupTable[k] = sum / Hns;
+		double u = m_hIntegralN + m_pRandom->nextUniformDouble() * (m_hIntegralX1 - m_hIntegralN);
+		double x = hIntegralInverse(u);
+		int32_t k = static_cast<int32_t>(x + 0.5);
+		if (k < 1) k = 1;
+		else if (k > m_n) k = m_n;
+		if (k - x <= m_squeeze || u >= hIntegral(k + 0.5) - h(k)) return k + m_min;
 	}
 }
 
-int32_t Tools::PRGZipf::nextLong()
+void Tools::PRGZipf::fill(int32_t* out, size_t n)
 {
-	uint32_t N = m_max - m_min;
-	double dart = m_pRandom->nextUniformDouble();
-	double* i = std::lower_bound(m_pLookupTable, m_pLookupTable + N, dart);
-
-	assert(i >= m_pLookupTable && i <= m_pLookupTable + N - 1);
-
-	int32_t ret = static_cast<int32_t>(i - m_pLookupTable) + m_min;
+	// the uniforms are drawn in batches, which the generator can produce
+	// far faster than one at a time; the few that are rejected are redrawn
+	// singly by nextLong
+	double u[256];
+	double range = m_hIntegralX1 - m_hIntegralN;
 
-	assert(ret >= m_min && ret < m_max);
-	return ret;
+	for (size_t i = 0; i < n; i += 256)
+	{
+		size_t m = std::min<size_t>(256, n - i);
+		m_pRandom->fillDouble(u, m);
+		for (size_t j = 0; j < m; ++j)
+		{
+			double v = m_hIntegralN + u[j] * range;
+			double x = hIntegralInverse(v);
+			int32_t k = static_cast<int32_t>(x + 0.5);
+			if (k < 1) k = 1;
+			else if (k > m_n) k = m_n;
+			if (k - x <= m_squeeze || v >= hIntegral(k + 0.5) - h(k)) out[i + j] = k + m_min;
+			else out[i + j] = nextLong();
+		}
+	}
 }
 
 Tools::Architecture Tools::System::getArchitecture()
@@ -51,6 +51,8 @@ extern long fourwise(int64_t, int64_t, int64_t, int64_t, int64_t);
 
 int64_t LLMedSelect(int k, int n, int64_t arr[]);
 int MedSelect(int k, int n, int arr[]);
+#define MEDNET_MAX 16 // largest array that MedNetwork sorts with a network
+int MedNetwork(int k, int n, int arr[]);
 
 typedef struct prng_type{
   int usenric; // which prng to use
@@ -105,7 +107,9 @@ namespace Tools
 	enum RandomGeneratorType
 	{
 		RGT_DRAND48 = 0x0,
-		RGT_MERSENNE
+		RGT_MERSENNE,
+		RGT_XOSHIRO256
+			// xoshiro256** (Blackman and Vigna), seeded by splitmix64
 	};
 
 	class Exception
@@ -182,6 +186,11 @@ namespace Tools
 			// returns a uniformly distributed double in the range [0, 1).
 		double nextUniformDouble(double low, double high);
 			// returns a uniformly distributed double in the range [low, high).
+
+		void fill(uint64_t* out, size_t n);
+			// writes the next n values of nextUniformUnsignedLongLong to out.
+		void fillDouble(double* out, size_t n);
+			// writes the next n values of nextUniformDouble to out.
 	
 		// these use the inversion method, thus they are extremely slow. Use with caution.
 		double nextNormalDouble();
@@ -210,6 +219,8 @@ namespace Tools
 	private:
 		void initMersenne();
 		void initDrand(uint16_t xsubi0);
+		void initXoshiro();
+		uint64_t nextXoshiro();
 
 		enum
 		{
@@ -234,20 +245,33 @@ namespace Tools
 
 	class PRGZipf
 	{
+		// Draws min + k for k in [1, max - min) with probability proportional
+		// to k^-s, by rejection-inversion (Hormann and Derflinger, "Rejection-
+		// inversion to generate variates from monotone discrete
+		// distributions", 1996): O(1) time and space per draw, with about one
+		// uniform double, a log and an exp.
 	public:
 		PRGZipf(int32_t min, int32_t max, double s, Tools::Random* pRandom);
 		virtual ~PRGZipf();
 
 		int32_t nextLong();
 
+		void fill(int32_t* out, size_t n);
+			// writes the next n draws to out.
+
 	private:
-		void initLookupTable();
+		double h(double x) const;
+		double hIntegral(double x) const;
+		double hIntegralInverse(double x) const;
 
 		int32_t m_min;
 		int32_t m_max;
 		double m_s;
 		Tools::Random* m_pRandom;
-		double* m_pLookupTable;
+		int32_t m_n;               // number of ranks
+		double m_hIntegralX1;      // hIntegral(1.5) - 1
+		double m_hIntegralN;       // hIntegral(m_n + 0.5)
+		double m_squeeze;          // ranks this close to x are accepted at once
 	}; // PRGZipf
 }
 
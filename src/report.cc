@@ -0,0 +1,120 @@
+/*
+ * Machine readable benchmark results, see report.h.
+ */
+#include "report.h"
+
+#include <math.h>
+
+Report::Report(FILE* out, int format) : out(out), format(format), header(false) {}
+
+Report::Value Report::Number(const std::string& name, double value) {
+	Value v;
+	char buf[32];
+
+	v.name = name;
+	v.quoted = false;
+	if (isfinite(value)) {
+		snprintf(buf, sizeof(buf), "%.10g", value);
+		v.text = buf;
+	}
+	return v;
+}
+
+void Report::SetParam(const Value& v) {
+	for (Value& p : params) {
+		if (p.name == v.name) {
+			p = v;
+			return;
+		}
+	}
+	params.push_back(v);
+}
+
+void Report::Param(const std::string& name, const std::string& value) {
+	Value v = {name, value, true};
+	SetParam(v);
+}
+
+void Report::Param(const std::string& name, double value) {
+	SetParam(Number(name, value));
+}
+
+void Report::Field(const std::string& name, const std::string& value) {
+	Value v = {name, value, true};
+	fields.push_back(v);
+}
+
+void Report::Field(const std::string& name, double value) {
+	fields.push_back(Number(name, value));
+}
+
+void Report::Field(const std::string& name, uint64_t value) {
+	Value v;
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%llu", (unsigned long long) value);
+	v.name = name;
+	v.text = buf;
+	v.quoted = false;
+	fields.push_back(v);
+}
+
+void Report::Write(const std::string& s, bool quoted) {
+	if (format == REPORT_JSON) {
+		if (!quoted) {
+			fputs(s.empty() ? "null" : s.c_str(), out);
+			return;
+		}
+		fputc('"', out);
+		for (unsigned char c : s) {
+			if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+			else if (c < 0x20) fprintf(out, "\\u%04x", c);
+			else fputc(c, out);
+		}
+		fputc('"', out);
+	} else {
+		// CSV: quote only when the text would split the line
+		if (!quoted || s.find_first_of(",\"\n\r") == std::string::npos) {
+			fputs(s.c_str(), out);
+			return;
+		}
+		fputc('"', out);
+		for (char c : s) {
+			if (c == '"') fputc('"', out);
+			fputc(c, out);
+		}
+		fputc('"', out);
+	}
+}
+
+void Report::End() {
+	std::vector<Value> all(params);
+	all.insert(all.end(), fields.begin(), fields.end());
+	fields.clear();
+
+	if (format == REPORT_JSON) {
+		fputc('{', out);
+		for (size_t i = 0; i < all.size(); ++i) {
+			if (i > 0) fputc(',', out);
+			Write(all[i].name, true);
+			fputc(':', out);
+			Write(all[i].text, all[i].quoted);
+		}
+		fputs("}\n", out);
+	} else if (format == REPORT_CSV) {
+		if (!header) {
+			for (size_t i = 0; i < all.size(); ++i) {
+				if (i > 0) fputc(',', out);
+				Write(all[i].name, true);
+			}
+			fputc('\n', out);
+			header = true;
+		}
+		for (size_t i = 0; i < all.size(); ++i) {
+			if (i > 0) fputc(',', out);
+			Write(all[i].text, all[i].quoted);
+		}
+		fputc('\n', out);
+	}
+	fflush(out);
+}
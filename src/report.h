@@ -0,0 +1,56 @@
+// report.h -- machine readable benchmark results, as JSON lines or CSV.
+//
+// A report holds the parameters of an experiment, which are repeated in
+// every record; setting a parameter again, as a sweep moves from one point
+// to the next, replaces its value.  Records are written one at a time:
+// fields are added with Field() and the record is written by End().
+// Every record of a CSV report must have the same fields in the same
+// order, since the header is taken from the first one.  Numbers that are
+// not finite are written as null in JSON and left empty in CSV.
+
+#ifndef REPORT_h
+#define REPORT_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define REPORT_TABLE 0 // no report, only the printed table
+#define REPORT_JSON 1
+#define REPORT_CSV 2
+
+class Report {
+public:
+	Report(FILE* out, int format);
+
+	void Param(const std::string& name, const std::string& value);
+	void Param(const std::string& name, double value);
+
+	void Field(const std::string& name, const std::string& value);
+	void Field(const std::string& name, double value);
+	void Field(const std::string& name, uint64_t value);
+
+	/**
+	 * Writes the parameters and the fields added since the last record.
+	 */
+	void End();
+
+private:
+	struct Value {
+		std::string name;
+		std::string text; // already formatted
+		bool quoted;
+	};
+
+	static Value Number(const std::string& name, double value);
+	void SetParam(const Value& v);
+	void Write(const std::string& s, bool quoted);
+
+	FILE* out;
+	int format;
+	bool header;
+	std::vector<Value> params, fields;
+};
+
+#endif
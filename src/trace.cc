@@ -0,0 +1,373 @@
+/********************************************************************
+Packet traces for the benchmarks.
+
+A trace is a list of (id, length) packets.  The text form is the one
+written by trace/postprocess.py, one "id length" pair per line.  Packet
+captures are read through pcap.h.  The
+binary form (see trace.h) stores the two columns packed and aligned, so
+it is mapped read-only and used in place: opening it costs no parsing
+and no copy, and runs on the same file share the page cache.
+*********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+#define TRACE_BUFSIZE (1<<20)
+
+static uint64_t Trace_Align(uint64_t x)
+{
+	return (x+TRACE_ALIGN-1) & ~((uint64_t) TRACE_ALIGN-1);
+}
+
+static Trace_type * Trace_Map(int fd, size_t size)
+{ // map a binary trace and check that its columns lie within the file
+	Trace_type * result;
+	const Trace_header * hdr;
+	void * map;
+
+	map=mmap(NULL,size,PROT_READ,MAP_SHARED,fd,0);
+	if (map==MAP_FAILED) return NULL;
+	hdr=(const Trace_header *) map;
+	if (hdr->version!=TRACE_VERSION || hdr->count>size/sizeof(uint32_t) ||
+		hdr->idOffset%TRACE_ALIGN || hdr->lenOffset%TRACE_ALIGN ||
+		hdr->idOffset>size || hdr->lenOffset>size ||
+		size-hdr->idOffset<hdr->count*sizeof(uint32_t) ||
+		size-hdr->lenOffset<hdr->count*sizeof(uint32_t))
+	{
+		fprintf(stderr,"Corrupt or unsupported trace header\n");
+		munmap(map,size);
+		return NULL;
+	}
+	madvise(map,size,MADV_SEQUENTIAL);
+
+	result=(Trace_type *) calloc(1,sizeof(Trace_type));
+	result->count=hdr->count;
+	result->total=hdr->total;
+	result->id=(const uint32_t *) ((const char *) map+hdr->idOffset);
+	result->len=(const uint32_t *) ((const char *) map+hdr->lenOffset);
+	result->map=map;
+	result->mapsize=size;
+	return result;
+}
+
+Trace_type * Trace_Open(const char * fname, int key, int bits)
+{ // map a binary trace if the file starts with the magic string,
+  // otherwise read the text or capture into memory
+	Trace_type * result;
+	Trace_header hdr;
+	struct stat st;
+	int fd;
+
+	fd=open(fname,O_RDONLY);
+	if (fd<0) return NULL;
+	if (fstat(fd,&st)<0)
+	{
+		close(fd);
+		return NULL;
+	}
+	if ((size_t) st.st_size>=sizeof(hdr) &&
+		read(fd,&hdr,sizeof(hdr))==(ssize_t) sizeof(hdr) &&
+		memcmp(hdr.magic,TRACE_MAGIC,sizeof(hdr.magic))==0)
+	{
+		result=Trace_Map(fd,st.st_size);
+		close(fd); // the mapping stays valid
+		return result;
+	}
+	close(fd);
+	return Trace_Load(fname,key,bits);
+}
+
+static size_t Trace_ReadTextChunk(Trace_reader * r, uint32_t * id,
+								  uint32_t * len, size_t max)
+{ // parse up to max "id length" pairs.  As the benchmarks always have,
+  // empty packets are dropped
+	size_t n=0;
+	uint32_t v[2];
+	int field=0, digits=0;
+
+	v[0]=v[1]=0;
+	while (n<max)
+	{
+		if (r->bufpos==r->have)
+		{
+			r->have=r->eof ? 0 : fread(r->buf,1,TRACE_BUFSIZE,r->f);
+			r->bufpos=0;
+			r->eof=(r->have==0);
+		}
+		// a digit extends the current number; anything else ends it
+		if (!r->eof && r->buf[r->bufpos]>='0' && r->buf[r->bufpos]<='9')
+		{
+			v[field]=v[field]*10+(r->buf[r->bufpos++]-'0');
+			digits=1;
+			continue;
+		}
+		if (!r->eof && r->buf[r->bufpos]!=' ' && r->buf[r->bufpos]!='\t' &&
+			r->buf[r->bufpos]!='\n' && r->buf[r->bufpos]!='\r')
+		{ // not a number: stop here, as stream extraction does
+			r->done=1;
+			break;
+		}
+		if (digits && ++field==2)
+		{
+			if (v[1]>0)
+			{
+				id[n]=v[0];
+				len[n]=v[1];
+				n++;
+				r->total+=v[1];
+			}
+			field=0;
+			v[0]=v[1]=0;
+		}
+		digits=0;
+		if (r->eof)
+		{
+			r->done=1;
+			break;
+		}
+		r->bufpos++;
+	}
+	return n;
+}
+
+Trace_type * Trace_Load(const char * fname, int key, int bits)
+{ // read a whole trace of any form into memory
+	Trace_type * result;
+	Trace_reader * r;
+	size_t cap, n;
+
+	r=Trace_ReaderInit(fname,key,bits);
+	if (r==NULL) return NULL;
+	result=(Trace_type *) calloc(1,sizeof(Trace_type));
+	cap=1<<16;
+	result->ids=(uint32_t *) malloc(cap*sizeof(uint32_t));
+	result->lens=(uint32_t *) malloc(cap*sizeof(uint32_t));
+	while (1)
+	{
+		if (result->count==cap)
+		{
+			cap*=2;
+			result->ids=(uint32_t *) realloc(result->ids,cap*sizeof(uint32_t));
+			result->lens=(uint32_t *) realloc(result->lens,cap*sizeof(uint32_t));
+		}
+		n=Trace_Read(r,result->ids+result->count,result->lens+result->count,
+					 cap-result->count);
+		if (n==0) break;
+		result->count+=n;
+	}
+	result->total=r->total;
+	Trace_ReaderDestroy(r);
+
+	result->id=result->ids;
+	result->len=result->lens;
+	return result;
+}
+
+Trace_writer * Trace_WriterInit(const char * fname)
+{ // start a binary trace.  The ids go straight to the file and the
+  // lengths to a temporary file, as the count is not known in advance
+	Trace_writer * result;
+	Trace_header hdr;
+
+	result=(Trace_writer *) calloc(1,sizeof(Trace_writer));
+	result->f=fopen(fname,"wb");
+	result->lens=tmpfile();
+	memset(&hdr,0,sizeof(hdr)); // written for real once the count is known
+	if (result->f==NULL || result->lens==NULL ||
+		fwrite(&hdr,sizeof(hdr),1,result->f)!=1)
+	{
+		if (result->f) fclose(result->f);
+		if (result->lens) fclose(result->lens);
+		free(result);
+		return NULL;
+	}
+	return result;
+}
+
+void Trace_WriterAdd(Trace_writer * w, const uint32_t * id, const uint32_t * len,
+					 size_t n)
+{
+	size_t i;
+
+	if (fwrite(id,sizeof(uint32_t),n,w->f)!=n ||
+		fwrite(len,sizeof(uint32_t),n,w->lens)!=n)
+		w->failed=1;
+	w->count+=n;
+	for (i=0; i<n; i++)
+		w->total+=len[i];
+}
+
+int Trace_WriterDestroy(Trace_writer * w)
+{ // append the lengths, write the header and close; returns 0 on success
+	Trace_header hdr;
+	char pad[TRACE_ALIGN];
+	char * buf;
+	size_t got;
+	int ok;
+
+	memset(&hdr,0,sizeof(hdr));
+	memcpy(hdr.magic,TRACE_MAGIC,sizeof(hdr.magic));
+	hdr.version=TRACE_VERSION;
+	hdr.count=w->count;
+	hdr.total=w->total;
+	hdr.idOffset=sizeof(hdr); // already a multiple of TRACE_ALIGN
+	hdr.lenOffset=Trace_Align(hdr.idOffset+w->count*sizeof(uint32_t));
+
+	memset(pad,0,sizeof(pad));
+	ok=!w->failed;
+	ok=ok && fwrite(pad,1,hdr.lenOffset-hdr.idOffset-w->count*sizeof(uint32_t),w->f)==
+		hdr.lenOffset-hdr.idOffset-w->count*sizeof(uint32_t);
+	buf=(char *) malloc(TRACE_BUFSIZE);
+	rewind(w->lens);
+	while (ok && (got=fread(buf,1,TRACE_BUFSIZE,w->lens))>0)
+		ok=fwrite(buf,1,got,w->f)==got;
+	free(buf);
+	ok=ok && !ferror(w->lens);
+	ok=ok && fseek(w->f,0,SEEK_SET)==0 && fwrite(&hdr,sizeof(hdr),1,w->f)==1;
+	ok=(fclose(w->f)==0) && ok;
+	fclose(w->lens);
+	free(w);
+	return ok ? 0 : -1;
+}
+
+int Trace_Write(const char * fname, const uint32_t * id, const uint32_t * len,
+				size_t count)
+{ // write a binary trace from memory; returns 0 on success
+	Trace_writer * w;
+
+	w=Trace_WriterInit(fname);
+	if (w==NULL) return -1;
+	Trace_WriterAdd(w,id,len,count);
+	return Trace_WriterDestroy(w);
+}
+
+void Trace_Destroy(Trace_type * trace)
+{
+	if (trace->map) munmap(trace->map,trace->mapsize);
+	free(trace->ids);
+	free(trace->lens);
+	free(trace);
+}
+
+Trace_reader * Trace_ReaderInit(const char * fname, int key, int bits)
+{ // open a trace of any form for reading in chunks; key and bits choose
+  // the ids of a capture
+	Trace_reader * result;
+	Trace_header hdr;
+	struct stat st;
+	ssize_t got;
+	int fd;
+
+	fd=open(fname,O_RDONLY);
+	if (fd<0) return NULL;
+	if (fstat(fd,&st)<0)
+	{
+		close(fd);
+		return NULL;
+	}
+	result=(Trace_reader *) calloc(1,sizeof(Trace_reader));
+	result->fd=-1;
+	got=read(fd,&hdr,sizeof(hdr));
+	if (got==(ssize_t) sizeof(hdr) &&
+		memcmp(hdr.magic,TRACE_MAGIC,sizeof(hdr.magic))==0)
+	{
+		if (hdr.version!=TRACE_VERSION || hdr.count>(uint64_t) st.st_size ||
+			hdr.idOffset>(uint64_t) st.st_size || hdr.lenOffset>(uint64_t) st.st_size ||
+			hdr.idOffset+hdr.count*sizeof(uint32_t)>(uint64_t) st.st_size ||
+			hdr.lenOffset+hdr.count*sizeof(uint32_t)>(uint64_t) st.st_size)
+		{
+			fprintf(stderr,"Corrupt or unsupported trace header\n");
+			close(fd);
+			free(result);
+			return NULL;
+		}
+		posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+		result->binary=1;
+		result->fd=fd;
+		result->count=hdr.count;
+		result->idOffset=hdr.idOffset;
+		result->lenOffset=hdr.lenOffset;
+		return result;
+	}
+	close(fd);
+	if (got>0 && Pcap_IsCapture(&hdr,got))
+	{
+		result->pcap=Pcap_Init(fname,key,bits);
+		if (result->pcap==NULL)
+		{
+			free(result);
+			return NULL;
+		}
+		return result;
+	}
+	result->f=fopen(fname,"r");
+	if (result->f==NULL)
+	{
+		free(result);
+		return NULL;
+	}
+	result->buf=(char *) malloc(TRACE_BUFSIZE);
+	return result;
+}
+
+static int Trace_ReadFully(int fd, void * dst, size_t bytes, uint64_t offset)
+{ // pread until all bytes are in, or fail
+	ssize_t got;
+
+	while (bytes>0)
+	{
+		got=pread(fd,dst,bytes,offset);
+		if (got<=0) return -1;
+		dst=(char *) dst+got;
+		bytes-=got;
+		offset+=got;
+	}
+	return 0;
+}
+
+size_t Trace_Read(Trace_reader * r, uint32_t * id, uint32_t * len, size_t max)
+{ // read up to max packets into id and len; returns 0 at the end
+	size_t n, i;
+
+	if (r->done) return 0;
+	if (r->pcap)
+	{
+		n=Pcap_Read(r->pcap,id,len,max);
+		for (i=0; i<n; i++)
+			r->total+=len[i];
+		if (n==0) r->done=1;
+		return n;
+	}
+	if (!r->binary) return Trace_ReadTextChunk(r,id,len,max);
+
+	n=(r->count-r->pos<max) ? r->count-r->pos : max;
+	if (Trace_ReadFully(r->fd,id,n*sizeof(uint32_t),
+						r->idOffset+r->pos*sizeof(uint32_t))<0 ||
+		Trace_ReadFully(r->fd,len,n*sizeof(uint32_t),
+						r->lenOffset+r->pos*sizeof(uint32_t))<0)
+	{
+		fprintf(stderr,"Error reading trace\n");
+		r->done=1;
+		return 0;
+	}
+	r->pos+=n;
+	for (i=0; i<n; i++)
+		r->total+=len[i];
+	if (r->pos==r->count) r->done=1;
+	return n;
+}
+
+void Trace_ReaderDestroy(Trace_reader * r)
+{
+	if (r->fd>=0) close(r->fd);
+	if (r->f) fclose(r->f);
+	if (r->pcap) Pcap_Destroy(r->pcap);
+	free(r->buf);
+	free(r);
+}
@@ -0,0 +1,91 @@
+// trace.h -- packet traces of (id, length) pairs, read from the text
+// dumps written by trace/postprocess.py, from packet captures (pcap.h),
+// or from a binary file that is mapped straight into memory.
+//
+// Binary layout, all fields in host (little endian) byte order:
+//   0   char magic[8]      "DSTRACE1"
+//   8   uint32 version     TRACE_VERSION
+//   12  uint32 flags       0, reserved
+//   16  uint64 count       number of packets
+//   24  uint64 total       sum of the lengths
+//   32  uint64 idOffset    file offset of count uint32 ids
+//   40  uint64 lenOffset   file offset of count uint32 lengths
+//   48  padding up to TRACE_ALIGN bytes
+// Both columns start on a TRACE_ALIGN boundary.
+
+#ifndef TRACE_h
+#define TRACE_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "pcap.h"
+
+#define TRACE_MAGIC "DSTRACE1"
+#define TRACE_VERSION 1
+#define TRACE_ALIGN 64
+
+typedef struct Trace_header{
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t count;
+  uint64_t total;
+  uint64_t idOffset;
+  uint64_t lenOffset;
+  char pad[TRACE_ALIGN-48];
+} Trace_header;
+
+typedef struct Trace_type{
+  size_t count;
+  uint64_t total;
+  const uint32_t * id;
+  const uint32_t * len;
+  void * map; // the mapped file, or NULL when the trace was parsed from text
+  size_t mapsize;
+  uint32_t * ids, * lens; // storage for a parsed text trace
+} Trace_type;
+
+// A reader hands out a trace of either form in chunks, holding only its
+// read buffer, so traces larger than memory can be replayed.
+typedef struct Trace_reader{
+  int binary;
+  uint64_t total; // bytes handed out so far
+  int done;
+  // binary traces are read with pread from the two columns
+  int fd;
+  uint64_t count, pos;
+  uint64_t idOffset, lenOffset;
+  // text traces are parsed from a buffer
+  FILE * f;
+  char * buf;
+  size_t have, bufpos;
+  int eof;
+  Pcap_type * pcap; // set when reading a capture
+} Trace_reader;
+
+// A writer builds a binary trace from chunks of packets.
+typedef struct Trace_writer{
+  FILE * f;
+  FILE * lens; // temporary file for the length column
+  uint64_t count, total;
+  int failed;
+} Trace_writer;
+
+extern Trace_type * Trace_Open(const char *, int key=PCAP_KEY_SRC,
+							   int bits=PCAP_DOMAINBITS);
+extern Trace_type * Trace_Load(const char *, int key=PCAP_KEY_SRC,
+							   int bits=PCAP_DOMAINBITS);
+extern int Trace_Write(const char *, const uint32_t *, const uint32_t *, size_t);
+extern void Trace_Destroy(Trace_type *);
+
+extern Trace_reader * Trace_ReaderInit(const char *, int key=PCAP_KEY_SRC,
+									   int bits=PCAP_DOMAINBITS);
+extern size_t Trace_Read(Trace_reader *, uint32_t *, uint32_t *, size_t);
+extern void Trace_ReaderDestroy(Trace_reader *);
+
+extern Trace_writer * Trace_WriterInit(const char *);
+extern void Trace_WriterAdd(Trace_writer *, const uint32_t *, const uint32_t *, size_t);
+extern int Trace_WriterDestroy(Trace_writer *);
+
+#endif
@@ -0,0 +1,84 @@
+/********************************************************************
+Converts a text trace, as written by trace/postprocess.py, or a pcap or
+pcapng capture into the binary trace format of trace.h, which hh, wfu
+and cmpar map directly.  The input is streamed, so captures larger than
+memory can be converted.
+*********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "trace.h"
+
+#define CVT_CHUNK (1<<20)
+
+void usage() {
+	fprintf(stderr,
+		"Usage: tracecvt [options] <text trace or capture> <binary trace>\n"
+		"\t-key      id of a captured packet: src, dst, srcport or flow (src)\n"
+		"\t-bits     ids are hashed into 2^bits items (%d)\n",
+		PCAP_DOMAINBITS);
+}
+
+int main(int argc, char **argv) {
+	int key = PCAP_KEY_SRC;
+	int bits = PCAP_DOMAINBITS;
+	int i;
+
+	for (i = 1; i + 2 < argc; ++i) {
+		if (strcmp(argv[i], "-key") == 0) {
+			i++;
+			if (strcmp(argv[i], "src") == 0) key = PCAP_KEY_SRC;
+			else if (strcmp(argv[i], "dst") == 0) key = PCAP_KEY_DST;
+			else if (strcmp(argv[i], "srcport") == 0) key = PCAP_KEY_SRCPORT;
+			else if (strcmp(argv[i], "flow") == 0) key = PCAP_KEY_FLOW;
+			else {
+				usage();
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-bits") == 0) {
+			i++;
+			bits = atoi(argv[i]);
+		}
+		else {
+			usage();
+			return -1;
+		}
+	}
+	if (i + 2 != argc) {
+		usage();
+		return -1;
+	}
+
+	Trace_reader* reader = Trace_ReaderInit(argv[i], key, bits);
+	if (reader == NULL) {
+		fprintf(stderr, "Unable to load file %s\n", argv[i]);
+		return 1;
+	}
+	Trace_writer* writer = Trace_WriterInit(argv[i + 1]);
+	if (writer == NULL) {
+		fprintf(stderr, "Unable to write file %s\n", argv[i + 1]);
+		Trace_ReaderDestroy(reader);
+		return 1;
+	}
+	std::vector<uint32_t> id(CVT_CHUNK), len(CVT_CHUNK);
+	size_t n;
+	while ((n = Trace_Read(reader, &id[0], &len[0], CVT_CHUNK)) > 0) {
+		Trace_WriterAdd(writer, &id[0], &len[0], n);
+	}
+	uint64_t count = writer->count, total = writer->total;
+	if (reader->pcap) {
+		printf("Read %llu captured packets, skipped %llu that were not IP\n",
+			(unsigned long long) reader->pcap->packets,
+			(unsigned long long) reader->pcap->skipped);
+	}
+	Trace_ReaderDestroy(reader);
+	if (Trace_WriterDestroy(writer) != 0) {
+		fprintf(stderr, "Unable to write file %s\n", argv[i + 1]);
+		return 1;
+	}
+	printf("Wrote %llu packets, %llu bytes in total, to %s\n",
+		(unsigned long long) count, (unsigned long long) total, argv[i + 1]);
+	return 0;
+}
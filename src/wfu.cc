@@ -6,6 +6,7 @@
 #include "alosumpp.h"
 #include "countmin.h"  // naive count min sketch
 #include "dimsum.h"  // new dimsum++ algorithm for more space efficiency
+#include "trace.h"
 
 #define VERBOSE_STATS true
 #define VERBOSE_EXACT false
@@ -218,34 +219,18 @@ size_t RunExact(uint64_t thresh, std::vector<uint32_t>& exact) {
 }
 
 
-void load_data(std::string fname, std::vector<uint32_t> &data,
-               std::vector<uint32_t> &values) {
-    uint64_t total = 0;
+/**
+ * Opens a trace, mapping it when it is binary (see trace.h).
+ */
+Trace_type* load_data(std::string fname) {
     std::cout << "Using file: " << fname << std::endl;
-    std::ifstream f;
-    f.open(fname);
-    if (!f) {
+    Trace_type* trace = Trace_Open(fname.c_str());
+    if (trace == NULL) {
         std::cout << "Unable to load file" << std::endl;
         exit(1);
     }
-    uint32_t id, length;
-    while (f >> id >> length) {
-        // std::cout << id << " " << length << std::endl;
-        if (length <= 0) continue; // Packets should not be empty!
-        if (total < 0) {
-            std::cerr << "Why is total negative? " << total<<std::endl;
-            break;
-        }
-        if ((total + length) >= 0x7FFFFFFE) {
-            std::cerr <<  "Error! total number of bytes is " << total << " and trying to add " << length << std::endl;
-            std::cerr << "Stopping before we overflow anything. " << std::endl;
-            break;
-        }
-        data.push_back(id);
-        values.push_back(length);
-        total += length;
-    }
-    std::cerr << "Finished loading file. Total number of bytes: " << total << std::endl;
+    std::cerr << "Finished loading file. Total number of bytes: " << trace->total << std::endl;
+    return trace;
 }
 
 int main(int argc, char** argv) {
@@ -256,9 +241,10 @@ int main(int argc, char** argv) {
 
     uint32_t u32DomainSize = 1048575;
 	std::vector<uint32_t> exact(u32DomainSize + 1, 0);
-    std::vector<uint32_t> data, values;
-    load_data("../trace/sanjose.dmp", data, values);
-    size_t stRunSize = data.size() / stRuns;
+    Trace_type* trace = load_data("../trace/sanjose.dmp");
+    const uint32_t* data = trace->id;
+    const uint32_t* values = trace->len;
+    size_t stRunSize = trace->count / stRuns;
     
     size_t stStreamPos = 0;
 	long long total = 0;
@@ -313,5 +299,6 @@ int main(int argc, char** argv) {
 	} 
 
     ALS als(0.1, 1);
+    Trace_Destroy(trace);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+/********************************************************************
+Writes a synthetic workload (see workload.h) as a binary trace, which
+hh, wfu and cmpar then map like any other.  The stream is generated on
+all cores a batch at a time, the next batch while the last one is
+written, so traces far larger than memory take minutes to write.
+hh generates the same streams itself when it is given no trace file.
+*********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "trace.h"
+#include "workload.h"
+
+using Clock = std::chrono::steady_clock;
+
+void usage() {
+	fprintf(stderr,
+		"Usage: wlgen [options] <binary trace>\n"
+		"\t-n        number of packets (10000000)\n"
+		"\t-z        skew of the Zipf ids (1)\n"
+		"\t-j        threads (all cores)\n"
+		"\t-h        print this help\n");
+	Workload_Usage();
+}
+
+int main(int argc, char **argv) {
+	Workload_params p;
+	uint64_t count = 10000000;
+	const char* path = NULL;
+	int i, used;
+
+	Workload_Defaults(&p);
+	for (i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-h") == 0) {
+			usage();
+			return 0;
+		}
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			count = strtoull(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc) {
+			p.skew = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			p.threads = atoi(argv[++i]);
+		}
+		else if ((used = Workload_Option(&p, argc, argv, i)) > 0) {
+			i += used - 1;
+		}
+		else if (argv[i][0] != '-' && path == NULL) {
+			path = argv[i];
+		}
+		else {
+			usage();
+			return -1;
+		}
+	}
+	if (path == NULL) {
+		usage();
+		return -1;
+	}
+
+	if (p.adversary == WORKLOAD_ADV_COLLIDE && p.advParam == 0) {
+		fprintf(stderr, "-adversary collide needs the size of the hashtable\n");
+		return -1;
+	}
+	Trace_writer* writer = Trace_WriterInit(path);
+	if (writer == NULL) {
+		fprintf(stderr, "Unable to write file %s\n", path);
+		return 1;
+	}
+	Workload_type* w = Workload_Init(&p, count);
+	size_t batch = (size_t) WORKLOAD_BLOCK * w->p.threads;
+	std::vector<uint32_t> id[2], len[2];
+	for (int b = 0; b < 2; ++b) {
+		id[b].resize(batch);
+		len[b].resize(batch);
+	}
+	auto start = Clock::now();
+	size_t n = Workload_Read(w, &id[0][0], &len[0][0], batch);
+	for (int b = 0; n > 0; b ^= 1) {
+		size_t next = 0;
+		std::thread gen([&, b] { next = Workload_Read(w, &id[b ^ 1][0], &len[b ^ 1][0], batch); });
+		Trace_WriterAdd(writer, &id[b][0], &len[b][0], n);
+		gen.join();
+		n = next;
+	}
+	uint64_t total = writer->total;
+	Workload_Destroy(w);
+	if (Trace_WriterDestroy(writer) != 0) {
+		fprintf(stderr, "Unable to write file %s\n", path);
+		return 1;
+	}
+	double s = std::chrono::duration<double>(Clock::now() - start).count();
+	printf("Wrote %llu packets, %llu bytes in total, to %s in %.1f s\n",
+		(unsigned long long) count, (unsigned long long) total, path, s);
+	return 0;
+}
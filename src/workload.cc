@@ -0,0 +1,363 @@
+/********************************************************************
+Synthetic packet streams for the benchmarks, see workload.h.
+
+Each block of the stream is drawn from two generators seeded by the
+block's index: one for the ids and one for the lengths and bursts, so
+that streams of different skews share their lengths.  Blocks are
+handed out to the threads in turn and written straight into the
+caller's buffers; only a block that is cut by the requested range goes
+through a buffer of its own.
+*********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "prng.h"
+#include "workload.h"
+
+#define WORKLOAD_SEEDSTEP 0x9E3779B9 // seeds of consecutive blocks
+#define WORKLOAD_SIDESEED 0x5BD1E995 // seeds the lengths apart from the ids
+#define WORKLOAD_TABLEHASHA 151261303 // the hashtables of DIM-SUM and IM-SUM
+#define WORKLOAD_TABLEHASHB 6722461
+#define WORKLOAD_BATCH 256 // uniforms drawn at a time
+
+void Workload_Defaults(Workload_params * p)
+{ // Zipf ids of skew 1 over 2^20 items, hashed as hh always has, length 1
+	prng_type * prng;
+
+	memset(p,0,sizeof(Workload_params));
+	p->seed=0xF4A54B;
+	prng=prng_Init(44545,2);
+	p->a=(int64_t) (prng_int(prng) % MOD);
+	p->b=(int64_t) (prng_int(prng) % MOD);
+	prng_Destroy(prng);
+	p->domain=1048575;
+	p->ids=WORKLOAD_IDS_ZIPF;
+	p->skew=1.0;
+	p->sizes=WORKLOAD_SIZES_FIXED;
+	p->size1=1;
+	p->maxSize=65535;
+	p->burstShare=1.0;
+}
+
+void Workload_Usage()
+{
+	fprintf(stderr,
+		"\t-ids      zipf or uniform ids (zipf)\n"
+		"\t-bits     ids are hashed into 2^bits items (20)\n"
+		"\t-sizes    fixed[:n], lognormal:mu:sigma or pareto:shape:scale (fixed:1)\n"
+		"\t-maxsize  cap on the sizes (65535)\n"
+		"\t-burst    every:length[:share], one new id in a share of each burst\n"
+		"\t-drift    ids the ranks shift by every million packets\n"
+		"\t-adversary distinct, collide:hashtable size or tie:ids\n"
+		"\t-seed     seed of the synthetic stream\n");
+}
+
+static int Workload_Numbers(const char * s, double * x, int max)
+{ // parses up to max numbers separated by colons; returns how many
+	char * end;
+	int n=0;
+
+	while (n<max) {
+		x[n]=strtod(s,&end);
+		if (end==s) return -1;
+		n++;
+		if (*end==0) return n;
+		if (*end!=':') return -1;
+		s=end+1;
+	}
+	return -1;
+}
+
+int Workload_Option(Workload_params * p, int argc, char ** argv, int i)
+{ // parses the option at argv[i]: returns the number of arguments used,
+  // 0 if it is not a workload option and -1 if it is malformed
+	const char * opt=argv[i];
+	const char * val;
+	double x[3];
+	int n;
+
+	if (strcmp(opt,"-ids") && strcmp(opt,"-bits") && strcmp(opt,"-sizes") &&
+		strcmp(opt,"-maxsize") && strcmp(opt,"-burst") && strcmp(opt,"-drift") &&
+		strcmp(opt,"-seed") && strcmp(opt,"-adversary"))
+		return 0;
+	if (i+1>=argc) {
+		fprintf(stderr,"Missing value of %s\n",opt);
+		return -1;
+	}
+	val=argv[i+1];
+	if (strcmp(opt,"-ids")==0) {
+		if (strcmp(val,"zipf")==0) p->ids=WORKLOAD_IDS_ZIPF;
+		else if (strcmp(val,"uniform")==0) p->ids=WORKLOAD_IDS_UNIFORM;
+		else return -1;
+	}
+	else if (strcmp(opt,"-bits")==0) {
+		n=atoi(val);
+		if (n<1 || n>31) return -1;
+		p->domain=(1u<<n)-1;
+	}
+	else if (strcmp(opt,"-sizes")==0) {
+		if (strncmp(val,"fixed",5)==0) {
+			p->sizes=WORKLOAD_SIZES_FIXED;
+			p->size1=1;
+			if (val[5]==':' && Workload_Numbers(val+6,&p->size1,1)!=1) return -1;
+			if (val[5]!=':' && val[5]!=0) return -1;
+		}
+		else if (strncmp(val,"lognormal:",10)==0) {
+			p->sizes=WORKLOAD_SIZES_LOGNORMAL;
+			if (Workload_Numbers(val+10,x,2)!=2 || x[1]<0) return -1;
+			p->size1=x[0];
+			p->size2=x[1];
+		}
+		else if (strncmp(val,"pareto:",7)==0) {
+			p->sizes=WORKLOAD_SIZES_PARETO;
+			if (Workload_Numbers(val+7,x,2)!=2 || x[0]<=0 || x[1]<=0) return -1;
+			p->size1=x[0];
+			p->size2=x[1];
+		}
+		else return -1;
+	}
+	else if (strcmp(opt,"-maxsize")==0) {
+		p->maxSize=(uint32_t) strtoul(val,NULL,10);
+		if (p->maxSize<1) return -1;
+	}
+	else if (strcmp(opt,"-burst")==0) {
+		n=Workload_Numbers(val,x,3);
+		if (n<2 || x[0]<1 || x[1]<0 || x[1]>x[0]) return -1;
+		p->burstEvery=(uint64_t) x[0];
+		p->burstLength=(uint64_t) x[1];
+		p->burstShare=(n==3) ? x[2] : 1.0;
+	}
+	else if (strcmp(opt,"-drift")==0) {
+		p->drift=atof(val);
+	}
+	else if (strcmp(opt,"-adversary")==0) {
+		p->advParam=0;
+		if (strcmp(val,"none")==0) p->adversary=WORKLOAD_ADV_NONE;
+		else if (strcmp(val,"distinct")==0) p->adversary=WORKLOAD_ADV_DISTINCT;
+		else if (strncmp(val,"collide",7)==0) p->adversary=WORKLOAD_ADV_COLLIDE;
+		else if (strncmp(val,"tie",3)==0) p->adversary=WORKLOAD_ADV_TIE;
+		else return -1;
+		val=strchr(val,':');
+		if (val) {
+			if (p->adversary==WORKLOAD_ADV_NONE || p->adversary==WORKLOAD_ADV_DISTINCT ||
+				Workload_Numbers(val+1,x,1)!=1 || x[0]<1 || x[0]>=MOD)
+				return -1;
+			p->advParam=(uint64_t) x[0];
+		}
+		// without a size, the caller picks one for the algorithm under test
+		if (p->adversary==WORKLOAD_ADV_TIE && p->advParam==0) p->advParam=1<<16;
+	}
+	else if (strcmp(opt,"-seed")==0) {
+		p->seed=(uint32_t) strtoul(val,NULL,0);
+	}
+	return 2;
+}
+
+Workload_type * Workload_Init(const Workload_params * p, uint64_t count)
+{
+	Workload_type * result;
+
+	result=(Workload_type *) calloc(1,sizeof(Workload_type));
+	result->p=*p;
+	if (result->p.threads<1)
+		result->p.threads=std::max(1u,std::thread::hardware_concurrency());
+	result->count=count;
+	return result;
+}
+
+static uint32_t Workload_Size(double x, uint32_t max)
+{ // a drawn size, at least 1 and at most max
+	if (!(x<max)) return max;
+	if (x<1) return 1;
+	return (uint32_t) x;
+}
+
+static int64_t Workload_MulMod(int64_t x, int64_t y)
+{ // x*y mod 2^31-1, for x and y below it
+	return (int64_t) (((uint64_t) x*(uint64_t) y) % MOD);
+}
+
+static int64_t Workload_Inverse(int64_t a)
+{ // a^(p-2), the inverse of a mod the prime p = 2^31-1
+	int64_t r=1, e;
+
+	for (e=MOD-2; e>0; e>>=1) {
+		if (e&1) r=Workload_MulMod(r,a);
+		a=Workload_MulMod(a,a);
+	}
+	return r;
+}
+
+static void Workload_Adversary(const Workload_params * p, uint64_t begin, size_t n,
+							   uint32_t * id)
+{
+	size_t i;
+
+	if (p->adversary==WORKLOAD_ADV_DISTINCT) {
+		for (i=0; i<n; i++)
+			id[i]=hash31(p->a,p->b,(int64_t) ((begin+i) % MOD));
+	}
+	else if (p->adversary==WORKLOAD_ADV_COLLIDE) {
+		// hash31 is x -> a*x+b mod p, so the keys of bucket 0 are the
+		// inverses of the multiples of the table size, taken in turn.  Its
+		// reduction is one short when it wraps, so of the preimages x and
+		// x+p of y, and failing those of y+1, the first that hashes to a
+		// multiple is taken.
+		int64_t inverse=Workload_Inverse(WORKLOAD_TABLEHASHA);
+		uint64_t keys=(MOD-1)/p->advParam;
+		for (i=0; i<n; i++) {
+			int64_t y=(int64_t) (((begin+i) % keys)*p->advParam);
+			int64_t x=Workload_MulMod((y-WORKLOAD_TABLEHASHB+MOD) % MOD,inverse);
+			id[i]=(uint32_t) x;
+			for (int c=0; c<4; c++) {
+				int64_t cand=Workload_MulMod((y+c/2-WORKLOAD_TABLEHASHB+MOD) % MOD,inverse)+
+					(c%2)*MOD;
+				if (hash31(WORKLOAD_TABLEHASHA,WORKLOAD_TABLEHASHB,cand) % p->advParam==0) {
+					id[i]=(uint32_t) cand;
+					break;
+				}
+			}
+		}
+	}
+	else if (p->adversary==WORKLOAD_ADV_TIE) {
+		for (i=0; i<n; i++)
+			id[i]=hash31(p->a,p->b,(int64_t) ((begin+i) % p->advParam));
+	}
+}
+
+static void Workload_Block(const Workload_params * p, uint64_t block, size_t n,
+						   uint32_t * id, uint32_t * len)
+{ // the first n packets of a block
+	uint64_t begin=block*WORKLOAD_BLOCK;
+	uint32_t step=(uint32_t) block*WORKLOAD_SEEDSTEP;
+	Tools::Random r(p->seed+step,Tools::RGT_XOSHIRO256);
+	Tools::Random side((p->seed^WORKLOAD_SIDESEED)+step,Tools::RGT_XOSHIRO256);
+	int32_t * rank=(int32_t *) id; // replaced by the ids in place
+	double u[WORKLOAD_BATCH];
+	size_t i, j, m;
+
+	if (p->adversary!=WORKLOAD_ADV_NONE) {
+		Workload_Adversary(p,begin,n,id);
+	}
+	else if (p->ids==WORKLOAD_IDS_ZIPF) {
+		Tools::PRGZipf zipf(0,p->domain,p->skew,&r);
+		zipf.fill(rank,n);
+	}
+	else {
+		for (i=0; i<n; i+=m) {
+			m=std::min<size_t>(WORKLOAD_BATCH,n-i);
+			r.fillDouble(u,m);
+			for (j=0; j<m; j++)
+				rank[i+j]=(int32_t) (p->domain*u[j]);
+		}
+	}
+	if (p->adversary!=WORKLOAD_ADV_NONE) {
+		// the ids are already set
+	}
+	else if (p->drift!=0) {
+		for (i=0; i<n; i++)
+			id[i]=hash31(p->a,p->b,rank[i]+(int64_t) ((begin+i)*p->drift/1e6)) & p->domain;
+	}
+	else {
+		for (i=0; i<n; i++)
+			id[i]=hash31(p->a,p->b,rank[i]) & p->domain;
+	}
+
+	if (p->sizes==WORKLOAD_SIZES_LOGNORMAL) {
+		// Box-Muller, two normal variates from each pair of uniforms
+		for (i=0; i<n; i+=m) {
+			m=std::min<size_t>(WORKLOAD_BATCH,n-i);
+			side.fillDouble(u,(m+1)&~(size_t) 1);
+			for (j=0; j<m; j+=2) {
+				double radius=p->size2*sqrt(-2.0*log(1.0-u[j]));
+				len[i+j]=Workload_Size(1.0+floor(exp(p->size1+radius*cos(2*M_PI*u[j+1]))),p->maxSize);
+				if (j+1<m)
+					len[i+j+1]=Workload_Size(1.0+floor(exp(p->size1+radius*sin(2*M_PI*u[j+1]))),p->maxSize);
+			}
+		}
+	}
+	else if (p->sizes==WORKLOAD_SIZES_PARETO) {
+		for (i=0; i<n; i+=m) {
+			m=std::min<size_t>(WORKLOAD_BATCH,n-i);
+			side.fillDouble(u,m);
+			for (j=0; j<m; j++)
+				len[i+j]=Workload_Size(floor(p->size2/pow(1.0-u[j],1.0/p->size1)),p->maxSize);
+		}
+	}
+	else {
+		uint32_t size=Workload_Size(p->size1,p->maxSize);
+		for (i=0; i<n; i++)
+			len[i]=size;
+	}
+
+	if (p->burstEvery>0 && p->burstLength>0) {
+		// burst k covers [k*burstEvery, k*burstEvery+burstLength) and its
+		// id is the hash of a rank beyond the domain
+		uint64_t k;
+		for (k=begin/p->burstEvery; k*p->burstEvery<begin+n; k++) {
+			uint64_t from=std::max(k*p->burstEvery,begin);
+			uint64_t to=std::min(k*p->burstEvery+p->burstLength,begin+n);
+			uint32_t burstId=hash31(p->a,p->b,(int64_t) p->domain+1+k) & p->domain;
+			for (uint64_t j=from; j<to; j++) {
+				if (p->burstShare>=1.0 || side.nextUniformDouble()<p->burstShare)
+					id[j-begin]=burstId;
+			}
+		}
+	}
+}
+
+void Workload_Fill(Workload_type * w, uint64_t first, size_t n, uint32_t * id, uint32_t * len)
+{ // packets [first, first+n) of the stream, which must not run past its end
+	uint64_t firstBlock, lastBlock;
+	std::atomic<uint64_t> next;
+	int threads;
+
+	if (n==0) return;
+	firstBlock=first/WORKLOAD_BLOCK;
+	lastBlock=(first+n-1)/WORKLOAD_BLOCK;
+	next=firstBlock;
+	auto worker=[&]() {
+		std::vector<uint32_t> bufId, bufLen;
+		uint64_t c;
+		while ((c=next++)<=lastBlock) {
+			uint64_t begin=c*WORKLOAD_BLOCK;
+			size_t size=(size_t) std::min((uint64_t) WORKLOAD_BLOCK,w->count-begin);
+			uint64_t from=std::max(begin,first);
+			uint64_t to=std::min(begin+size,first+n);
+			if (from==begin && to==begin+size) {
+				Workload_Block(&w->p,c,size,id+(begin-first),len+(begin-first));
+				continue;
+			}
+			bufId.resize(WORKLOAD_BLOCK);
+			bufLen.resize(WORKLOAD_BLOCK);
+			Workload_Block(&w->p,c,size,&bufId[0],&bufLen[0]);
+			memcpy(id+(from-first),&bufId[from-begin],(to-from)*sizeof(uint32_t));
+			memcpy(len+(from-first),&bufLen[from-begin],(to-from)*sizeof(uint32_t));
+		}
+	};
+	threads=(int) std::min((uint64_t) w->p.threads,lastBlock-firstBlock+1);
+	std::vector<std::thread> pool;
+	for (int t=1; t<threads; t++)
+		pool.push_back(std::thread(worker));
+	worker();
+	for (std::thread & t : pool)
+		t.join();
+}
+
+size_t Workload_Read(Workload_type * w, uint32_t * id, uint32_t * len, size_t n)
+{ // the next n packets or fewer, 0 at the end of the stream
+	if (n>w->count-w->pos) n=(size_t) (w->count-w->pos);
+	Workload_Fill(w,w->pos,n,id,len);
+	w->pos+=n;
+	return n;
+}
+
+void Workload_Destroy(Workload_type * w)
+{
+	free(w);
+}
@@ -0,0 +1,77 @@
+// workload.h -- synthetic packet streams of (id, length) pairs, generated
+// in parallel and reproducibly.
+//
+// The ids are ranks drawn from a Zipf distribution, or uniformly, and
+// hashed over the domain; the lengths are fixed or drawn from a lognormal
+// or Pareto distribution.  On top of that the stream may have bursts,
+// windows in which a share of the packets carry one new id, and drift,
+// a shift of the rank to id mapping that makes the heavy hitters change
+// and new ids appear as the stream goes on.
+//
+// Adversarial streams replace the ids to stress the table maintenance of
+// DIM-SUM: every id distinct, so the active table fills as fast as it
+// can; distinct ids that all fall in one bucket of a hashtable of the
+// given size under the hash31 constants of DIM-SUM and IM-SUM; or a
+// round robin over a set of ids, so that all counts tie with the
+// quantile every maintenance computes.  These ids are not masked to
+// the domain.
+//
+// The stream is cut into blocks of WORKLOAD_BLOCK packets, each drawn
+// from its own generator seeded by its index, so any part of it can be
+// generated on its own and the stream is the same whatever the number
+// of threads.
+
+#ifndef WORKLOAD_h
+#define WORKLOAD_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WORKLOAD_BLOCK (1<<20)
+
+#define WORKLOAD_IDS_ZIPF 0
+#define WORKLOAD_IDS_UNIFORM 1
+
+#define WORKLOAD_ADV_NONE 0
+#define WORKLOAD_ADV_DISTINCT 1
+#define WORKLOAD_ADV_COLLIDE 2 // advParam is the size of the hashtable
+#define WORKLOAD_ADV_TIE 3     // advParam is the number of ids
+
+#define WORKLOAD_SIZES_FIXED 0
+#define WORKLOAD_SIZES_LOGNORMAL 1 // 1 + floor(exp(N(p1, p2)))
+#define WORKLOAD_SIZES_PARETO 2    // floor(p2 / U^(1/p1)), shape p1, scale p2
+
+typedef struct Workload_params{
+  uint32_t seed;
+  int64_t a, b;         // hash of the ranks to the ids
+  uint32_t domain;      // ranks lie below it; ids are masked with it
+  int ids;
+  double skew;
+  int adversary;        // replaces the ids when set
+  uint64_t advParam;
+  int sizes;
+  double size1, size2;  // parameters of the size distribution
+  uint32_t maxSize;     // sizes are capped at this
+  uint64_t burstEvery;  // a burst starts every burstEvery packets, 0 for none
+  uint64_t burstLength;
+  double burstShare;    // share of a burst's packets that carry its id
+  double drift;         // the ranks shift by this many ids per million packets
+  int threads;          // 0 for all the cores
+} Workload_params;
+
+typedef struct Workload_type{
+  Workload_params p;
+  uint64_t count;       // packets in the stream
+  uint64_t pos;         // next packet handed out by Workload_Read
+} Workload_type;
+
+extern void Workload_Defaults(Workload_params *);
+extern int Workload_Option(Workload_params *, int, char **, int);
+extern void Workload_Usage();
+
+extern Workload_type * Workload_Init(const Workload_params *, uint64_t);
+extern void Workload_Fill(Workload_type *, uint64_t, size_t, uint32_t *, uint32_t *);
+extern size_t Workload_Read(Workload_type *, uint32_t *, uint32_t *, size_t);
+extern void Workload_Destroy(Workload_type *);
+
+#endif